@@ -0,0 +1,169 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+using System.Threading;
+using SimpleJSON;
+
+namespace BepInLauncher
+{
+    /// <summary>
+    /// Collapses files with identical contents in the file system tree to a single canonical file.
+    /// </summary>
+    /// <remarks>
+    /// Files are first grouped by size; only files that share their size with another file are hashed.
+    /// Files with the same hash are compared byte by byte before they are merged.
+    ///
+    /// The tree keeps the original path of every file, because writes must still go to the file the mod shipped.
+    /// The canonical path is appended after a '|' and VirtualFS uses it for read-only opens.
+    /// </remarks>
+    internal static class FileDeduplicator
+    {
+        private const int BufferSize = 1 << 16;
+
+        private class TreeFile
+        {
+            public JSONObject Parent;
+            public string Name;
+            public string Path;
+            public long Size;
+            public ulong Hash;
+        }
+
+        public static void Deduplicate(JSONObject tree, string reportPath, params string[] excludedRoots)
+        {
+            List<TreeFile> files = new List<TreeFile>();
+            CollectFiles(tree, files, excludedRoots.Select(Path.GetFullPath).ToArray());
+
+            foreach (TreeFile file in files)
+                file.Size = new FileInfo(file.Path).Length;
+
+            // Files with a unique size cannot have a duplicate
+            List<TreeFile> candidates = files.GroupBy(f => f.Size)
+                                             .Where(g => g.Count() > 1 && g.Key > 0)
+                                             .SelectMany(g => g)
+                                             .ToList();
+
+            HashFiles(candidates);
+
+            StringBuilder report = new StringBuilder();
+            int duplicateFiles = 0;
+            long savedBytes = 0;
+
+            foreach (var group in candidates.GroupBy(f => new { f.Size, f.Hash }))
+            {
+                List<TreeFile> remaining = group.ToList();
+
+                while (remaining.Count > 1)
+                {
+                    TreeFile canonical = remaining[0];
+                    List<TreeFile> duplicates = remaining.Skip(1).Where(f => FilesEqual(canonical.Path, f.Path)).ToList();
+                    remaining = remaining.Skip(1).Except(duplicates).ToList();
+
+                    if (duplicates.Count == 0)
+                        continue;
+
+                    report.AppendLine($"{canonical.Size} bytes, {duplicates.Count + 1} copies: {canonical.Path}");
+
+                    foreach (TreeFile duplicate in duplicates)
+                    {
+                        report.AppendLine($"    {duplicate.Path}");
+                        duplicate.Parent[duplicate.Name] = $"{duplicate.Path}|{canonical.Path}";
+                    }
+
+                    duplicateFiles += duplicates.Count;
+                    savedBytes += canonical.Size * duplicates.Count;
+                }
+            }
+
+            string summary = $"{files.Count} files, {candidates.Count} hashed, {duplicateFiles} duplicates, {savedBytes} bytes shared";
+            Console.WriteLine($"Deduplication: {summary}");
+
+            File.WriteAllText(reportPath, summary + Environment.NewLine + Environment.NewLine + report);
+        }
+
+        private static void CollectFiles(JSONObject tree, List<TreeFile> files, string[] excludedRoots)
+        {
+            foreach (KeyValuePair<string, JSONNode> entry in tree.Linq)
+            {
+                if (entry.Value.IsObject)
+                    CollectFiles(entry.Value.AsObject, files, excludedRoots);
+                else if (!excludedRoots.Any(root => entry.Value.Value.StartsWith(root, StringComparison.OrdinalIgnoreCase)))
+                    files.Add(new TreeFile { Parent = tree, Name = entry.Key, Path = entry.Value.Value });
+            }
+        }
+
+        // Hashes the files on all cores
+        private static void HashFiles(List<TreeFile> files)
+        {
+            int next = -1;
+
+            Thread[] threads = Enumerable.Range(0, Environment.ProcessorCount).Select(i => new Thread(() =>
+            {
+                byte[] buffer = new byte[BufferSize];
+                int index;
+
+                while ((index = Interlocked.Increment(ref next)) < files.Count)
+                    files[index].Hash = HashFile(files[index].Path, buffer);
+            })).ToArray();
+
+            foreach (Thread thread in threads)
+                thread.Start();
+
+            foreach (Thread thread in threads)
+                thread.Join();
+        }
+
+        private static ulong HashFile(string path, byte[] buffer)
+        {
+            XxHash64 hash = new XxHash64();
+
+            using (FileStream stream = new FileStream(path, FileMode.Open, FileAccess.Read, FileShare.Read, BufferSize))
+            {
+                int read;
+                while ((read = stream.Read(buffer, 0, buffer.Length)) > 0)
+                    hash.Update(buffer, 0, read);
+            }
+
+            return hash.Digest();
+        }
+
+        private static bool FilesEqual(string path1, string path2)
+        {
+            byte[] buffer1 = new byte[BufferSize];
+            byte[] buffer2 = new byte[BufferSize];
+
+            using (FileStream stream1 = new FileStream(path1, FileMode.Open, FileAccess.Read, FileShare.Read))
+            using (FileStream stream2 = new FileStream(path2, FileMode.Open, FileAccess.Read, FileShare.Read))
+            {
+                while (true)
+                {
+                    int read1 = ReadFully(stream1, buffer1);
+                    int read2 = ReadFully(stream2, buffer2);
+
+                    if (read1 != read2)
+                        return false;
+
+                    if (read1 == 0)
+                        return true;
+
+                    for (int i = 0; i < read1; i++)
+                        if (buffer1[i] != buffer2[i])
+                            return false;
+                }
+            }
+        }
+
+        private static int ReadFully(Stream stream, byte[] buffer)
+        {
+            int total = 0;
+            int read;
+
+            while (total < buffer.Length && (read = stream.Read(buffer, total, buffer.Length - total)) > 0)
+                total += read;
+
+            return total;
+        }
+    }
+}
@@ -0,0 +1,154 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+using SimpleJSON;
+
+namespace BepInLauncher
+{
+    /// <summary>
+    /// Packs the files the game opened during a recorded launch into one contiguous file.
+    /// </summary>
+    /// <remarks>
+    /// Files are stored in the order the game first opened them, so that a launch reads the pack front to back.
+    /// Files that were not opened stay loose.
+    ///
+    /// Packed tree entries are stored as "original|*offset:size", or "original|canonical|*offset:size" for deduplicated
+    /// files. VirtualFS serves read-only opens of them from the pack until the file is opened for writing, and everything
+    /// else from the original file.
+    /// The pack is only rebuilt when the recording or any of the packed files changed.
+    /// </remarks>
+    internal static class PackBuilder
+    {
+        public const string PackPath = "vfs.pack";
+        public const string IndexPath = "vfs.pack.txt";
+
+        private class PackEntry
+        {
+            public string Path;
+            public long Offset;
+            public long Size;
+        }
+
+        public static void Apply(JSONObject tree, string recordPath, params string[] excludedRoots)
+        {
+            // Read path (canonical file of deduplicated entries) of every file in the tree by its original path
+            Dictionary<string, string> readPaths = new Dictionary<string, string>(StringComparer.OrdinalIgnoreCase);
+            CollectReadPaths(tree, readPaths);
+
+            excludedRoots = excludedRoots.Select(Path.GetFullPath).ToArray();
+
+            List<string> packedFiles = File.ReadAllLines(recordPath, Encoding.UTF8)
+                                           .Where(p => readPaths.ContainsKey(p))
+                                           .Select(p => readPaths[p])
+                                           .Where(p => !excludedRoots.Any(root => p.StartsWith(root, StringComparison.OrdinalIgnoreCase)))
+                                           .Distinct(StringComparer.OrdinalIgnoreCase)
+                                           .Where(File.Exists)
+                                           .ToList();
+
+            List<PackEntry> index = ReadIndex(recordPath, packedFiles) ?? BuildPack(packedFiles);
+            Dictionary<string, PackEntry> entries = index.ToDictionary(e => e.Path, StringComparer.OrdinalIgnoreCase);
+
+            PointToPack(tree, entries);
+
+            Console.WriteLine($"Pack: {index.Count} files, {index.Sum(e => e.Size)} bytes");
+        }
+
+        private static void CollectReadPaths(JSONObject tree, Dictionary<string, string> readPaths)
+        {
+            foreach (KeyValuePair<string, JSONNode> entry in tree.Linq)
+            {
+                if (entry.Value.IsObject)
+                {
+                    CollectReadPaths(entry.Value.AsObject, readPaths);
+                    continue;
+                }
+
+                string[] parts = entry.Value.Value.Split('|');
+                readPaths[parts[0]] = parts.Length > 1 ? parts[1] : parts[0];
+            }
+        }
+
+        private static void PointToPack(JSONObject tree, Dictionary<string, PackEntry> entries)
+        {
+            foreach (KeyValuePair<string, JSONNode> entry in tree.Linq.ToList())
+            {
+                if (entry.Value.IsObject)
+                {
+                    PointToPack(entry.Value.AsObject, entries);
+                    continue;
+                }
+
+                string[] parts = entry.Value.Value.Split('|');
+                string readPath = parts.Length > 1 ? parts[1] : parts[0];
+
+                // The canonical copy stays in the entry, as writes to it have to stop the file being read from the pack
+                PackEntry packEntry;
+                if (entries.TryGetValue(readPath, out packEntry))
+                    tree[entry.Key] = $"{entry.Value.Value}|*{packEntry.Offset}:{packEntry.Size}";
+            }
+        }
+
+        // Reads the index of the existing pack, or returns null if the pack has to be rebuilt
+        private static List<PackEntry> ReadIndex(string recordPath, List<string> packedFiles)
+        {
+            if (!File.Exists(PackPath) || !File.Exists(IndexPath))
+                return null;
+
+            DateTime packTime = File.GetLastWriteTimeUtc(PackPath);
+
+            if (File.GetLastWriteTimeUtc(recordPath) > packTime)
+                return null;
+
+            List<PackEntry> index = File.ReadAllLines(IndexPath, Encoding.UTF8).Select(line =>
+            {
+                string[] parts = line.Split('\t');
+                return new PackEntry { Offset = long.Parse(parts[0]), Size = long.Parse(parts[1]), Path = parts[2] };
+            }).ToList();
+
+            if (!index.Select(e => e.Path).SequenceEqual(packedFiles, StringComparer.OrdinalIgnoreCase))
+                return null;
+
+            foreach (PackEntry entry in index)
+            {
+                FileInfo info = new FileInfo(entry.Path);
+
+                if (!info.Exists || info.Length != entry.Size || info.LastWriteTimeUtc > packTime)
+                    return null;
+            }
+
+            return index;
+        }
+
+        private static List<PackEntry> BuildPack(List<string> packedFiles)
+        {
+            Console.WriteLine("Building pack");
+
+            List<PackEntry> index = new List<PackEntry>();
+            byte[] buffer = new byte[1 << 20];
+
+            using (FileStream pack = new FileStream(PackPath, FileMode.Create, FileAccess.Write, FileShare.None))
+            {
+                foreach (string path in packedFiles)
+                {
+                    PackEntry entry = new PackEntry { Path = path, Offset = pack.Position };
+
+                    using (FileStream file = new FileStream(path, FileMode.Open, FileAccess.Read, FileShare.Read))
+                    {
+                        int read;
+                        while ((read = file.Read(buffer, 0, buffer.Length)) > 0)
+                            pack.Write(buffer, 0, read);
+                    }
+
+                    entry.Size = pack.Position - entry.Offset;
+                    index.Add(entry);
+                }
+            }
+
+            File.WriteAllLines(IndexPath, index.Select(e => $"{e.Offset}\t{e.Size}\t{e.Path}").ToArray(), Encoding.UTF8);
+
+            return index;
+        }
+    }
+}
@@ -11,6 +11,12 @@ namespace BepInLauncher
 {
     class Program
     {
+        // File opens recorded by VirtualFS, in the order the game first opened the files
+        const string OpenRecordPath = "vfs_opens.txt";
+
+        // Profiles list the mod folders to enable, one per line in load order
+        const string ProfilesPath = "profiles";
+
         public static string GamePath { get; set; }
 
         [STAThread]
@@ -31,33 +37,72 @@ namespace BepInLauncher
                 GamePath = dialog.FileName;
                 Console.WriteLine($"Selected file: {GamePath}");
 
-                Console.WriteLine("Creating file system tree");
-                CreateFileSystemTree();
+                if (args.Contains("--lazy"))
+                {
+                    // VirtualFS resolves the folders from the mod layers itself when there is no tree file
+                    Console.WriteLine("Using lazily resolved file system layers");
+                    PrepareLazyLayers();
+                }
+                else
+                {
+                    Console.WriteLine("Creating file system tree");
+                    CreateFileSystemTree(args.Contains("--dedup"), args.Contains("--pack"), GetOption(args, "--profile"));
+                }
 
                 Console.WriteLine("Launching the game with custom Doorstop args!");
-                LaunchGame();
+                LaunchGame(args.Contains("--record-opens"));
             }
         }
 
-        static void LaunchGame()
+        static string GetOption(string[] args, string name)
         {
-            Process p = Process.Start(GamePath, $"--doorstop-enable true --doorstop-target \"{Path.GetFullPath("BepInEx\\bin\\BepInPreloader.dll")}\"");
+            int index = Array.IndexOf(args, name);
+
+            return index >= 0 && index + 1 < args.Length ? args[index + 1] : null;
         }
 
-        static void CreateFileSystemTree()
+        static void LaunchGame(bool recordOpens)
         {
-            JSONObject o = new JSONObject();
+            ProcessStartInfo info = new ProcessStartInfo(GamePath, $"--doorstop-enable true --doorstop-target \"{Path.GetFullPath("BepInEx\\bin\\BepInPreloader.dll")}\"")
+            {
+                    UseShellExecute = false
+            };
 
-            o["BepInEx"] = new JSONObject();
+            if (recordOpens)
+                info.EnvironmentVariables["BEPINVFS_RECORD_OPENS"] = Path.GetFullPath(OpenRecordPath);
 
-            GenTree(o["BepInEx"].AsObject, "BepInEx");
+            Process p = Process.Start(info);
+        }
 
+        static void CreateFileSystemTree(bool deduplicate, bool pack, string profile)
+        {
             if (!Directory.Exists("__temp__"))
                 Directory.CreateDirectory("__temp__");
-            GenTree(o, "__temp__");
 
-            foreach (string modDir in Directory.GetDirectories("mods"))
-                GenTree(o, modDir);
+            List<TreeComposer.Layer> layers = new List<TreeComposer.Layer>
+            {
+                    new TreeComposer.Layer("BepInEx", "BepInEx"),
+                    new TreeComposer.Layer("__temp__", "")
+            };
+
+            foreach (string modDir in GetModDirectories(profile))
+                layers.Add(new TreeComposer.Layer(modDir, ""));
+
+            JSONObject o = TreeComposer.Compose(layers);
+
+            // Files in __temp__ are written by the game, so they are never shared
+            if (deduplicate)
+                FileDeduplicator.Deduplicate(o, "vfs_dedup.txt", "__temp__");
+
+            if (pack)
+            {
+                if (File.Exists(OpenRecordPath))
+                    PackBuilder.Apply(o, OpenRecordPath, "__temp__");
+                else
+                    Console.WriteLine("No recorded launch to build the pack from, run with --record-opens first");
+            }
+            else
+                RemovePack();
 
             StringBuilder sb = new StringBuilder();
 
@@ -66,26 +111,59 @@ namespace BepInLauncher
             File.WriteAllText("vfs.json", sb.ToString());
         }
 
-        static void GenTree(JSONObject treeRoot, string path)
+        // Gets the mod folders to enable in load order: the ones the profile lists, or every folder in mods
+        static List<string> GetModDirectories(string profile)
         {
-            path = Path.GetFullPath(path);
+            if (profile == null)
+                return Directory.GetDirectories("mods").ToList();
 
-            // TODO: Handle ambiguities
+            string profilePath = Path.Combine(ProfilesPath, profile + ".txt");
 
-            foreach (string directory in Directory.GetDirectories(path))
+            if (!File.Exists(profilePath))
             {
-                string dirName = Path.GetFileName(directory);
-
-                JSONObject subdir = treeRoot[dirName].AsObject;
-                GenTree(subdir, directory);
+                Console.WriteLine($"No profile at {profilePath}, enabling every mod");
+                return Directory.GetDirectories("mods").ToList();
             }
 
-            foreach (string file in Directory.GetFiles(path))
+            List<string> modDirs = new List<string>();
+
+            foreach (string line in File.ReadAllLines(profilePath, Encoding.UTF8))
             {
-                string fileName = Path.GetFileName(file);
+                string name = line.Trim();
+
+                if (name.Length == 0 || name.StartsWith("#"))
+                    continue;
 
-                treeRoot[fileName] = file;
+                string modDir = Path.Combine("mods", name);
+
+                if (Directory.Exists(modDir))
+                    modDirs.Add(modDir);
+                else
+                    Console.WriteLine($"Profile {profile} lists {name}, which is not in mods");
             }
+
+            return modDirs;
+        }
+
+        static void PrepareLazyLayers()
+        {
+            if (!Directory.Exists("__temp__"))
+                Directory.CreateDirectory("__temp__");
+
+            if (File.Exists("vfs.json"))
+                File.Delete("vfs.json");
+
+            RemovePack();
+        }
+
+        // VirtualFS hooks the file reads whenever there is a pack, so remove it when it is not used
+        static void RemovePack()
+        {
+            if (File.Exists(PackBuilder.PackPath))
+                File.Delete(PackBuilder.PackPath);
+
+            if (File.Exists(PackBuilder.IndexPath))
+                File.Delete(PackBuilder.IndexPath);
         }
     }
 }
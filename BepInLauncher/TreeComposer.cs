@@ -0,0 +1,529 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+using System.Linq;
+using System.Text;
+using SimpleJSON;
+
+namespace BepInLauncher
+{
+    /// <summary>
+    /// Composes the file system tree from one precompiled fragment per layer (BepInEx, __temp__ and every enabled mod).
+    /// </summary>
+    /// <remarks>
+    /// A fragment lists the folders and files of a layer relative to the layer folder. Fragments are cached by their
+    /// fingerprint (an xxHash64 of the listing) and reused as long as no folder in the layer changed; the write time of a
+    /// folder changes whenever an entry in it is created, deleted or renamed, so only the folders have to be checked.
+    ///
+    /// The composed tree is kept between runs as the stack of layers providing each path, topmost last.
+    /// Enabling, disabling, moving or changing a mod only takes its own fragment out of the stacks and puts it back,
+    /// and the files whose conflicts changed are written to vfs_conflicts.txt.
+    /// </remarks>
+    internal static class TreeComposer
+    {
+        public const string CachePath = "vfs_fragments";
+        public const string ConflictsPath = "vfs_conflicts.txt";
+
+        private const string FragmentExtension = ".fragment";
+
+        // Last line of composition.txt, so that a file that was cut short is not mistaken for a complete one
+        private const string CompositionEnd = "end";
+
+        // Separator of the paths in the tree, which always follow VirtualFS rather than the OS
+        private const char Separator = '\\';
+
+        private static readonly string StampsPath = Path.Combine(CachePath, "stamps.txt");
+        private static readonly string CompositionPath = Path.Combine(CachePath, "composition.txt");
+
+        public class Layer
+        {
+            public Layer(string root, string mount)
+            {
+                Root = Path.GetFullPath(root);
+                Mount = mount;
+            }
+
+            // Full path of the layer folder
+            public string Root { get; }
+
+            // Folder of the tree the layer is placed in, or empty for the game folder
+            public string Mount { get; }
+
+            public string Name => Path.GetFileName(Root);
+        }
+
+        private class Fragment
+        {
+            public ulong Fingerprint;
+
+            // Relative paths of the folders (ending with the separator) and the files of the layer
+            public string[] Entries;
+
+            // Write time of every folder of the layer by relative path, the layer folder itself being empty
+            public Dictionary<string, long> FolderTimes;
+        }
+
+        private class ComposedLayer
+        {
+            public string Root;
+            public string Mount;
+            public ulong Fingerprint;
+        }
+
+        private class Composition
+        {
+            public List<ComposedLayer> Layers = new List<ComposedLayer>();
+
+            // Roots of the layers providing each path, topmost last
+            public Dictionary<string, List<string>> Stacks = new Dictionary<string, List<string>>(StringComparer.OrdinalIgnoreCase);
+        }
+
+        public static JSONObject Compose(List<Layer> layers)
+        {
+            Stopwatch stopwatch = Stopwatch.StartNew();
+
+            if (!Directory.Exists(CachePath))
+                Directory.CreateDirectory(CachePath);
+
+            Dictionary<string, Fragment> stamps = ReadStamps();
+            List<Fragment> fragments = new List<Fragment>();
+            int rescanned = 0;
+
+            foreach (Layer layer in layers)
+                fragments.Add(GetFragment(layer, stamps, ref rescanned));
+
+            Composition composition = ReadComposition() ?? new Composition();
+            HashSet<int> kept = GetKeptLayers(composition.Layers, layers, fragments);
+
+            // The fragments of the layers that are taken out are needed to find their paths
+            Dictionary<ComposedLayer, string[]> removed = new Dictionary<ComposedLayer, string[]>();
+
+            for (int i = 0; i < composition.Layers.Count; i++)
+            {
+                if (kept.Contains(i))
+                    continue;
+
+                string[] entries = ReadFragment(composition.Layers[i].Fingerprint);
+
+                if (entries == null)
+                {
+                    // Start over if the cache lost a fragment
+                    composition = new Composition();
+                    kept.Clear();
+                    removed.Clear();
+                    break;
+                }
+
+                removed[composition.Layers[i]] = entries;
+            }
+
+            Dictionary<string, int> positions = new Dictionary<string, int>(StringComparer.OrdinalIgnoreCase);
+            for (int i = 0; i < layers.Count; i++)
+                positions[layers[i].Root] = i;
+
+            // Stacks of every path that is touched, as they were before
+            Dictionary<string, string[]> before = new Dictionary<string, string[]>(StringComparer.OrdinalIgnoreCase);
+
+            foreach (var layer in removed)
+            {
+                foreach (string path in GetMountedEntries(layer.Key.Mount, layer.Value))
+                {
+                    List<string> stack = GetStack(composition, path, before);
+                    stack.RemoveAll(root => string.Equals(root, layer.Key.Root, StringComparison.OrdinalIgnoreCase));
+
+                    if (stack.Count == 0)
+                        composition.Stacks.Remove(path);
+                }
+            }
+
+            int inserted = 0;
+
+            for (int i = 0; i < layers.Count; i++)
+            {
+                if (kept.Contains(GetComposedIndex(composition.Layers, layers[i], fragments[i])))
+                    continue;
+
+                inserted++;
+
+                foreach (string path in GetMountedEntries(layers[i].Mount, fragments[i].Entries))
+                {
+                    List<string> stack = GetStack(composition, path, before);
+
+                    int index = stack.FindIndex(root => positions[root] > i);
+                    stack.Insert(index < 0 ? stack.Count : index, layers[i].Root);
+                }
+            }
+
+            composition.Layers = layers.Select((layer, i) => new ComposedLayer { Root = layer.Root, Mount = layer.Mount, Fingerprint = fragments[i].Fingerprint })
+                                       .ToList();
+
+            int conflicts = WriteConflicts(composition, before, layers);
+
+            WriteComposition(composition);
+            WriteStamps(stamps);
+            RemoveUnusedFragments(stamps);
+
+            JSONObject tree = BuildTree(composition, layers.ToDictionary(l => l.Root, StringComparer.OrdinalIgnoreCase));
+
+            Console.WriteLine($"Composed {layers.Count} layers: {rescanned} rescanned, {removed.Count} taken out, {inserted} put in, {conflicts} conflicts changed ({stopwatch.ElapsedMilliseconds} ms)");
+
+            return tree;
+        }
+
+        // Gets the stack of a path, remembering how it looked before it is changed
+        private static List<string> GetStack(Composition composition, string path, Dictionary<string, string[]> before)
+        {
+            List<string> stack;
+
+            if (!composition.Stacks.TryGetValue(path, out stack))
+            {
+                stack = new List<string>();
+                composition.Stacks[path] = stack;
+            }
+
+            if (!before.ContainsKey(path))
+                before[path] = stack.ToArray();
+
+            return stack;
+        }
+
+        private static IEnumerable<string> GetMountedEntries(string mount, string[] entries)
+        {
+            if (mount.Length == 0)
+                return entries;
+
+            return new[] { mount + Separator }.Concat(entries.Select(e => mount + Separator + e));
+        }
+
+        // Index of the composed layer with the same folder, place and contents, or -1
+        private static int GetComposedIndex(List<ComposedLayer> composed, Layer layer, Fragment fragment)
+        {
+            return composed.FindIndex(c => string.Equals(c.Root, layer.Root, StringComparison.OrdinalIgnoreCase) &&
+                                           c.Mount == layer.Mount && c.Fingerprint == fragment.Fingerprint);
+        }
+
+        // Finds the composed layers that can stay where they are: the largest set of unchanged layers
+        // whose order relative to each other is the same as before. Every other layer is taken out and put back in
+        private static HashSet<int> GetKeptLayers(List<ComposedLayer> composed, List<Layer> layers, List<Fragment> fragments)
+        {
+            List<int> unchanged = layers.Select((layer, i) => GetComposedIndex(composed, layer, fragments[i]))
+                                        .Where(index => index >= 0)
+                                        .ToList();
+
+            // Longest increasing subsequence of the old positions; quadratic, but there are only a few hundred mods
+            int[] length = new int[unchanged.Count];
+            int[] previous = new int[unchanged.Count];
+            int best = -1;
+
+            for (int i = 0; i < unchanged.Count; i++)
+            {
+                length[i] = 1;
+                previous[i] = -1;
+
+                for (int j = 0; j < i; j++)
+                {
+                    if (unchanged[j] < unchanged[i] && length[j] + 1 > length[i])
+                    {
+                        length[i] = length[j] + 1;
+                        previous[i] = j;
+                    }
+                }
+
+                if (best < 0 || length[i] > length[best])
+                    best = i;
+            }
+
+            HashSet<int> kept = new HashSet<int>();
+
+            for (int i = best; i >= 0; i = previous[i])
+                kept.Add(unchanged[i]);
+
+            return kept;
+        }
+
+        private static Fragment GetFragment(Layer layer, Dictionary<string, Fragment> stamps, ref int rescanned)
+        {
+            // Folder times are taken before the files are listed, so a change during the scan is caught next time
+            Dictionary<string, long> folderTimes = new Dictionary<string, long>(StringComparer.OrdinalIgnoreCase)
+            {
+                    { "", Directory.GetLastWriteTimeUtc(layer.Root).Ticks }
+            };
+
+            foreach (string folder in Directory.GetDirectories(layer.Root, "*", SearchOption.AllDirectories))
+                folderTimes[GetRelativePath(layer.Root, folder)] = Directory.GetLastWriteTimeUtc(folder).Ticks;
+
+            Fragment cached;
+
+            if (stamps.TryGetValue(layer.Root, out cached) && cached.FolderTimes.Count == folderTimes.Count &&
+                folderTimes.All(t => cached.FolderTimes.ContainsKey(t.Key) && cached.FolderTimes[t.Key] == t.Value))
+            {
+                cached.Entries = ReadFragment(cached.Fingerprint);
+
+                if (cached.Entries != null)
+                    return cached;
+            }
+
+            rescanned++;
+
+            List<string> entries = folderTimes.Keys.Where(folder => folder.Length > 0).Select(folder => folder + Separator).ToList();
+            entries.AddRange(Directory.GetFiles(layer.Root, "*", SearchOption.AllDirectories).Select(file => GetRelativePath(layer.Root, file)));
+            entries.Sort(StringComparer.OrdinalIgnoreCase);
+
+            Fragment fragment = new Fragment { Entries = entries.ToArray(), FolderTimes = folderTimes };
+            fragment.Fingerprint = GetFingerprint(fragment.Entries);
+
+            string fragmentPath = GetFragmentPath(fragment.Fingerprint);
+
+            if (!File.Exists(fragmentPath))
+                File.WriteAllLines(fragmentPath, fragment.Entries, Encoding.UTF8);
+
+            stamps[layer.Root] = fragment;
+            return fragment;
+        }
+
+        private static string GetRelativePath(string root, string path)
+        {
+            return path.Substring(root.Length).TrimStart(Path.DirectorySeparatorChar).Replace(Path.DirectorySeparatorChar, Separator);
+        }
+
+        private static ulong GetFingerprint(string[] entries)
+        {
+            XxHash64 hash = new XxHash64();
+
+            foreach (string entry in entries)
+            {
+                byte[] bytes = Encoding.UTF8.GetBytes(entry + "\n");
+                hash.Update(bytes, 0, bytes.Length);
+            }
+
+            return hash.Digest();
+        }
+
+        private static string GetFragmentPath(ulong fingerprint)
+        {
+            return Path.Combine(CachePath, fingerprint.ToString("x16") + FragmentExtension);
+        }
+
+        private static string[] ReadFragment(ulong fingerprint)
+        {
+            string fragmentPath = GetFragmentPath(fingerprint);
+
+            return File.Exists(fragmentPath) ? File.ReadAllLines(fragmentPath, Encoding.UTF8) : null;
+        }
+
+        // Each line is the layer folder, the fingerprint and then pairs of relative folder paths and write times.
+        // Lines that do not parse (e.g. from a write that was cut short) are skipped, which rescans their layers
+        private static Dictionary<string, Fragment> ReadStamps()
+        {
+            Dictionary<string, Fragment> stamps = new Dictionary<string, Fragment>(StringComparer.OrdinalIgnoreCase);
+
+            if (!File.Exists(StampsPath))
+                return stamps;
+
+            foreach (string line in File.ReadAllLines(StampsPath, Encoding.UTF8))
+            {
+                string[] parts = line.Split('\t');
+                ulong fingerprint;
+
+                if (parts.Length < 4 || parts.Length % 2 != 0 || parts[1].Length != 16 ||
+                    !ulong.TryParse(parts[1], System.Globalization.NumberStyles.HexNumber, null, out fingerprint))
+                    continue;
+
+                Fragment fragment = new Fragment
+                {
+                        Fingerprint = fingerprint,
+                        FolderTimes = new Dictionary<string, long>(StringComparer.OrdinalIgnoreCase)
+                };
+
+                for (int i = 2; i + 1 < parts.Length && fragment != null; i += 2)
+                {
+                    long time;
+
+                    if (long.TryParse(parts[i + 1], out time))
+                        fragment.FolderTimes[parts[i]] = time;
+                    else
+                        fragment = null;
+                }
+
+                if (fragment != null)
+                    stamps[parts[0]] = fragment;
+            }
+
+            return stamps;
+        }
+
+        // Stamps of mods that are not enabled are kept, so that enabling them again does not rescan them
+        private static void WriteStamps(Dictionary<string, Fragment> stamps)
+        {
+            File.WriteAllLines(StampsPath, stamps.Where(s => Directory.Exists(s.Key))
+                                                 .Select(s => $"{s.Key}\t{s.Value.Fingerprint:x16}\t" +
+                                                              string.Join("\t", s.Value.FolderTimes.Select(t => $"{t.Key}\t{t.Value}").ToArray()))
+                                                 .ToArray(), Encoding.UTF8);
+        }
+
+        private static void RemoveUnusedFragments(Dictionary<string, Fragment> stamps)
+        {
+            HashSet<string> used = new HashSet<string>(stamps.Where(s => Directory.Exists(s.Key)).Select(s => Path.GetFullPath(GetFragmentPath(s.Value.Fingerprint))),
+                                                       StringComparer.OrdinalIgnoreCase);
+
+            foreach (string fragmentPath in Directory.GetFiles(CachePath, "*" + FragmentExtension))
+            {
+                if (!used.Contains(Path.GetFullPath(fragmentPath)))
+                    File.Delete(fragmentPath);
+            }
+        }
+
+        // The first line is the layer count, then come the layers (fingerprint, mount, folder), the stacks
+        // (path and the indices of its layers) and the end marker.
+        // Returns null if the file does not parse or is cut short, in which case the tree is composed from scratch
+        private static Composition ReadComposition()
+        {
+            if (!File.Exists(CompositionPath))
+                return null;
+
+            string[] lines = File.ReadAllLines(CompositionPath, Encoding.UTF8);
+            Composition composition = new Composition();
+            int layerCount;
+
+            if (lines.Length < 2 || lines[lines.Length - 1] != CompositionEnd || !int.TryParse(lines[0], out layerCount) ||
+                layerCount < 0 || lines.Length < layerCount + 2)
+                return null;
+
+            for (int i = 1; i <= layerCount; i++)
+            {
+                string[] parts = lines[i].Split('\t');
+                ulong fingerprint;
+
+                if (parts.Length != 3 || !ulong.TryParse(parts[0], System.Globalization.NumberStyles.HexNumber, null, out fingerprint))
+                    return null;
+
+                composition.Layers.Add(new ComposedLayer { Fingerprint = fingerprint, Mount = parts[1], Root = parts[2] });
+            }
+
+            for (int i = layerCount + 1; i < lines.Length - 1; i++)
+            {
+                string[] parts = lines[i].Split('\t');
+
+                if (parts.Length != 2)
+                    return null;
+
+                List<string> stack = new List<string>();
+
+                foreach (string index in parts[1].Split(','))
+                {
+                    int layer;
+
+                    if (!int.TryParse(index, out layer) || layer < 0 || layer >= layerCount)
+                        return null;
+
+                    stack.Add(composition.Layers[layer].Root);
+                }
+
+                composition.Stacks[parts[0]] = stack;
+            }
+
+            return composition;
+        }
+
+        private static void WriteComposition(Composition composition)
+        {
+            Dictionary<string, int> indices = new Dictionary<string, int>(StringComparer.OrdinalIgnoreCase);
+            for (int i = 0; i < composition.Layers.Count; i++)
+                indices[composition.Layers[i].Root] = i;
+
+            List<string> lines = new List<string> { composition.Layers.Count.ToString() };
+            lines.AddRange(composition.Layers.Select(l => $"{l.Fingerprint:x16}\t{l.Mount}\t{l.Root}"));
+            lines.AddRange(composition.Stacks.Select(s => $"{s.Key}\t{string.Join(",", s.Value.Select(root => indices[root].ToString()).ToArray())}"));
+            lines.Add(CompositionEnd);
+
+            File.WriteAllLines(CompositionPath, lines.ToArray(), Encoding.UTF8);
+        }
+
+        // Lists the files that started or stopped being provided by more than one layer, or whose layers changed.
+        // The layers of a file are listed bottom to top, so the last one wins
+        private static int WriteConflicts(Composition composition, Dictionary<string, string[]> before, List<Layer> layers)
+        {
+            Dictionary<string, string> names = layers.ToDictionary(l => l.Root, l => l.Name, StringComparer.OrdinalIgnoreCase);
+            StringBuilder report = new StringBuilder();
+            int count = 0;
+
+            foreach (var entry in before.OrderBy(e => e.Key, StringComparer.OrdinalIgnoreCase))
+            {
+                if (entry.Key[entry.Key.Length - 1] == Separator)
+                    continue;
+
+                List<string> after;
+                composition.Stacks.TryGetValue(entry.Key, out after);
+
+                bool wasConflict = entry.Value.Length > 1;
+                bool isConflict = after != null && after.Count > 1;
+
+                if (!wasConflict && !isConflict)
+                    continue;
+
+                if (wasConflict && isConflict && entry.Value.SequenceEqual(after, StringComparer.OrdinalIgnoreCase))
+                    continue;
+
+                count++;
+
+                if (!isConflict)
+                    report.AppendLine($"- {entry.Key}");
+                else
+                    report.AppendLine($"{(wasConflict ? "~" : "+")} {entry.Key}: {string.Join(" < ", after.Select(root => names[root]).ToArray())}");
+            }
+
+            File.WriteAllText(ConflictsPath, $"{count} conflicts changed (+ new, - resolved, ~ changed; the last layer wins)" + Environment.NewLine + Environment.NewLine + report);
+
+            return count;
+        }
+
+        private static JSONObject BuildTree(Composition composition, Dictionary<string, Layer> layers)
+        {
+            JSONObject tree = new JSONObject();
+            Dictionary<string, JSONObject> folders = new Dictionary<string, JSONObject>(StringComparer.OrdinalIgnoreCase) { { "", tree } };
+
+            Dictionary<string, int> positions = new Dictionary<string, int>(StringComparer.OrdinalIgnoreCase);
+            for (int i = 0; i < composition.Layers.Count; i++)
+                positions[composition.Layers[i].Root] = i;
+
+            // Parents are shorter than their children, so folders are created before anything in them
+            foreach (var entry in composition.Stacks.OrderBy(e => e.Key[e.Key.Length - 1] == Separator ? e.Key.Length : int.MaxValue))
+            {
+                bool isFolder = entry.Key[entry.Key.Length - 1] == Separator;
+                string path = entry.Key.TrimEnd(Separator);
+
+                // A file and a folder with the same name: the one from the higher layer wins.
+                // A folder that loses is never created, so everything in it is left out as well
+                List<string> other;
+                if (composition.Stacks.TryGetValue(isFolder ? path : path + Separator, out other) &&
+                    positions[other[other.Count - 1]] > positions[entry.Value[entry.Value.Count - 1]])
+                    continue;
+
+                int split = path.LastIndexOf(Separator);
+
+                JSONObject parent;
+                if (!folders.TryGetValue(split < 0 ? "" : path.Substring(0, split + 1), out parent))
+                    continue;
+
+                string name = path.Substring(split + 1);
+
+                if (isFolder)
+                {
+                    JSONObject folder = new JSONObject();
+                    parent[name] = folder;
+                    folders[entry.Key] = folder;
+                }
+                else
+                {
+                    Layer layer = layers[entry.Value[entry.Value.Count - 1]];
+                    string relativePath = layer.Mount.Length == 0 ? path : path.Substring(layer.Mount.Length + 1);
+
+                    parent[name] = Path.Combine(layer.Root, relativePath);
+                }
+            }
+
+            return tree;
+        }
+    }
+}
@@ -0,0 +1,145 @@
+﻿using System;
+
+namespace BepInLauncher
+{
+    /// <summary>
+    /// Streaming implementation of the xxHash64 non-cryptographic hash.
+    /// </summary>
+    internal class XxHash64
+    {
+        private const ulong Prime1 = 11400714785074694791UL;
+        private const ulong Prime2 = 14029467366897019727UL;
+        private const ulong Prime3 = 1609587929392839161UL;
+        private const ulong Prime4 = 9650029242287828579UL;
+        private const ulong Prime5 = 2870177450012600261UL;
+
+        private readonly byte[] pending = new byte[32];
+        private int pendingLength;
+        private ulong totalLength;
+        private ulong v1, v2, v3, v4;
+        private readonly ulong seed;
+
+        public XxHash64(ulong seed = 0)
+        {
+            this.seed = seed;
+            v1 = seed + Prime1 + Prime2;
+            v2 = seed + Prime2;
+            v3 = seed;
+            v4 = seed - Prime1;
+        }
+
+        public void Update(byte[] data, int offset, int count)
+        {
+            totalLength += (ulong)count;
+
+            // Finish the stripe left over from the last update
+            if (pendingLength > 0)
+            {
+                int take = Math.Min(32 - pendingLength, count);
+                Buffer.BlockCopy(data, offset, pending, pendingLength, take);
+                pendingLength += take;
+                offset += take;
+                count -= take;
+
+                if (pendingLength < 32)
+                    return;
+
+                ProcessStripe(pending, 0);
+                pendingLength = 0;
+            }
+
+            while (count >= 32)
+            {
+                ProcessStripe(data, offset);
+                offset += 32;
+                count -= 32;
+            }
+
+            Buffer.BlockCopy(data, offset, pending, 0, count);
+            pendingLength = count;
+        }
+
+        public ulong Digest()
+        {
+            ulong h;
+
+            if (totalLength >= 32)
+            {
+                h = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+                h = MergeRound(h, v1);
+                h = MergeRound(h, v2);
+                h = MergeRound(h, v3);
+                h = MergeRound(h, v4);
+            }
+            else
+                h = seed + Prime5;
+
+            h += totalLength;
+
+            int i = 0;
+
+            for (; i + 8 <= pendingLength; i += 8)
+            {
+                h ^= Round(0, ReadUInt64(pending, i));
+                h = RotateLeft(h, 27) * Prime1 + Prime4;
+            }
+
+            if (i + 4 <= pendingLength)
+            {
+                h ^= ReadUInt32(pending, i) * Prime1;
+                h = RotateLeft(h, 23) * Prime2 + Prime3;
+                i += 4;
+            }
+
+            for (; i < pendingLength; i++)
+            {
+                h ^= pending[i] * Prime5;
+                h = RotateLeft(h, 11) * Prime1;
+            }
+
+            h ^= h >> 33;
+            h *= Prime2;
+            h ^= h >> 29;
+            h *= Prime3;
+            h ^= h >> 32;
+
+            return h;
+        }
+
+        private void ProcessStripe(byte[] data, int offset)
+        {
+            v1 = Round(v1, ReadUInt64(data, offset));
+            v2 = Round(v2, ReadUInt64(data, offset + 8));
+            v3 = Round(v3, ReadUInt64(data, offset + 16));
+            v4 = Round(v4, ReadUInt64(data, offset + 24));
+        }
+
+        private static ulong Round(ulong acc, ulong input)
+        {
+            acc += input * Prime2;
+            acc = RotateLeft(acc, 31);
+            return acc * Prime1;
+        }
+
+        private static ulong MergeRound(ulong acc, ulong value)
+        {
+            acc ^= Round(0, value);
+            return acc * Prime1 + Prime4;
+        }
+
+        private static ulong RotateLeft(ulong value, int count)
+        {
+            return (value << count) | (value >> (64 - count));
+        }
+
+        private static ulong ReadUInt64(byte[] data, int offset)
+        {
+            return BitConverter.ToUInt64(data, offset);
+        }
+
+        private static ulong ReadUInt32(byte[] data, int offset)
+        {
+            return BitConverter.ToUInt32(data, offset);
+        }
+    }
+}
@@ -38,6 +38,7 @@ namespace BepInPreloader
 
             // Install VFS
             init_vfs(vfsPath, $"{gamePath}\\");
+            VfsQuery.Initialize(lib);
 
             // We're now in simulating BepInEx folder structure!
 
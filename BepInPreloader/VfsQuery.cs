@@ -0,0 +1,210 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Runtime.InteropServices;
+using System.Text;
+
+namespace BepInPreloader
+{
+    /// <summary>
+    /// Queries the VFS through the batched exports of VirtualFS.
+    /// </summary>
+    /// <remarks>
+    /// System.IO asks about one path per hooked call. ResolvePaths and ListTree answer a whole batch in a single call,
+    /// which is what scans like Directory.GetFiles(..., SearchOption.AllDirectories) over the plugins need.
+    /// The native layouts are described in VirtualFS/batch_query.h.
+    /// </remarks>
+    public static class VfsQuery
+    {
+        private const uint NoString = 0xFFFFFFFF;
+        private const uint NoParent = 0xFFFFFFFF;
+        private const int PackedEntrySize = 32;
+
+        private static ResolvePathsDelegate resolve_paths;
+        private static ListTreeDelegate list_tree;
+
+        [Flags]
+        public enum QueryFlags : uint
+        {
+            None = 0,
+            RealPaths = 1,
+            Attributes = 2 // Costs a file system call per file
+        }
+
+        public enum ResolvedKind : uint
+        {
+            None, // Not in the VFS; calls on the path go to the path itself
+            File,
+            Folder
+        }
+
+        public class ResolvedPath
+        {
+            public ResolvedKind Kind;
+            public FileAttributes Attributes;
+            public long Size;
+            public DateTime LastWriteTimeUtc;
+
+            // Null for folders in the VFS, or if real paths were not queried
+            public string RealPath;
+        }
+
+        public class TreeEntry
+        {
+            // Index of the parent folder entry, or -1 for the contents of the listed folder
+            public int Parent;
+
+            // Path relative to the listed folder
+            public string Path;
+
+            public FileAttributes Attributes;
+            public long Size;
+            public DateTime LastWriteTimeUtc;
+            public string RealPath;
+
+            public bool IsFolder => (Attributes & FileAttributes.Directory) != 0;
+        }
+
+        public static bool IsAvailable => resolve_paths != null && list_tree != null;
+
+        internal static void Initialize(IntPtr lib)
+        {
+            IntPtr resolvePaths = Loader.GetProcAddress(lib, "vfs_resolve_paths");
+            IntPtr listTree = Loader.GetProcAddress(lib, "vfs_list_tree");
+
+            if (resolvePaths == IntPtr.Zero || listTree == IntPtr.Zero)
+                return;
+
+            resolve_paths = (ResolvePathsDelegate) Marshal.GetDelegateForFunctionPointer(resolvePaths, typeof(ResolvePathsDelegate));
+            list_tree = (ListTreeDelegate) Marshal.GetDelegateForFunctionPointer(listTree, typeof(ListTreeDelegate));
+        }
+
+        /// <summary>
+        /// Resolves the paths the same way the hooked calls would, in a single call.
+        /// </summary>
+        public static ResolvedPath[] ResolvePaths(IList<string> paths, QueryFlags flags)
+        {
+            StringBuilder packed = new StringBuilder();
+
+            foreach (string path in paths)
+                packed.Append(path).Append('\0');
+
+            char[] packedPaths = packed.ToString().ToCharArray();
+            NativeResolvedPath[] results = new NativeResolvedPath[paths.Count];
+            char[] strings = new char[(flags & QueryFlags.RealPaths) != 0 ? packedPaths.Length * 2 : 0];
+
+            uint required = resolve_paths(packedPaths, (uint) paths.Count, flags, results, strings, (uint) strings.Length);
+
+            if (required > strings.Length)
+            {
+                strings = new char[required];
+                resolve_paths(packedPaths, (uint) paths.Count, flags, results, strings, (uint) strings.Length);
+            }
+
+            ResolvedPath[] resolved = new ResolvedPath[results.Length];
+
+            for (int i = 0; i < results.Length; i++)
+            {
+                resolved[i] = new ResolvedPath
+                {
+                        Kind = (ResolvedKind) results[i].Kind,
+                        Attributes = (FileAttributes) results[i].Attributes,
+                        Size = (long) results[i].FileSize,
+                        LastWriteTimeUtc = DateTime.FromFileTimeUtc((long) results[i].LastWriteTime),
+                        RealPath = results[i].RealPath == NoString ? null : new string(strings, (int) results[i].RealPath, (int) results[i].RealPathLength)
+                };
+            }
+
+            return resolved;
+        }
+
+        /// <summary>
+        /// Lists a VFS folder and everything under it in a single call.
+        /// Only files matching the pattern are listed; folders always are, and come before their contents.
+        /// </summary>
+        /// <returns>The entries, or null if the path is not a folder in the VFS</returns>
+        public static List<TreeEntry> ListTree(string path, string pattern, QueryFlags flags)
+        {
+            byte[] buffer = new byte[1 << 16];
+            uint count, required;
+
+            while (!list_tree(path, pattern, flags, buffer, (uint) buffer.Length, out count, out required))
+            {
+                if (required <= buffer.Length)
+                    return null;
+
+                buffer = new byte[required];
+            }
+
+            List<TreeEntry> entries = new List<TreeEntry>((int) count);
+            int offset = 0;
+
+            for (uint i = 0; i < count; i++)
+            {
+                uint size = BitConverter.ToUInt32(buffer, offset);
+                uint parent = BitConverter.ToUInt32(buffer, offset + 4);
+                int nameLength = BitConverter.ToUInt16(buffer, offset + 12);
+                int realPathLength = BitConverter.ToUInt16(buffer, offset + 14);
+                string name = Encoding.Unicode.GetString(buffer, offset + PackedEntrySize, nameLength * 2);
+
+                entries.Add(new TreeEntry
+                {
+                        Parent = parent == NoParent ? -1 : (int) parent,
+                        Path = parent == NoParent ? name : entries[(int) parent].Path + "\\" + name,
+                        Attributes = (FileAttributes) BitConverter.ToUInt32(buffer, offset + 8),
+                        Size = BitConverter.ToInt64(buffer, offset + 16),
+                        LastWriteTimeUtc = DateTime.FromFileTimeUtc(BitConverter.ToInt64(buffer, offset + 24)),
+                        RealPath = (flags & QueryFlags.RealPaths) != 0
+                                ? Encoding.Unicode.GetString(buffer, offset + PackedEntrySize + nameLength * 2, realPathLength * 2)
+                                : null
+                });
+
+                offset += (int) size;
+            }
+
+            return entries;
+        }
+
+        /// <summary>
+        /// Same as Directory.GetFiles(path, pattern, SearchOption.AllDirectories) for a folder in the VFS.
+        /// </summary>
+        /// <returns>The files, or null if the path is not a folder in the VFS</returns>
+        public static string[] GetFiles(string path, string pattern)
+        {
+            List<TreeEntry> entries = ListTree(path, pattern, QueryFlags.None);
+
+            if (entries == null)
+                return null;
+
+            List<string> files = new List<string>();
+
+            foreach (TreeEntry entry in entries)
+                if (!entry.IsFolder)
+                    files.Add(Path.Combine(path, entry.Path));
+
+            return files.ToArray();
+        }
+
+        [StructLayout(LayoutKind.Sequential)]
+        private struct NativeResolvedPath
+        {
+            public uint Kind;
+            public uint Attributes;
+            public ulong FileSize;
+            public ulong LastWriteTime;
+            public uint RealPath;
+            public uint RealPathLength;
+        }
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+        private delegate uint ResolvePathsDelegate([In] char[] paths, uint count, QueryFlags flags,
+                                                   [Out] NativeResolvedPath[] results, [Out] char[] strings,
+                                                   uint stringsLength);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl, CharSet = CharSet.Unicode)]
+        private delegate bool ListTreeDelegate([MarshalAs(UnmanagedType.LPWStr)] string path,
+                                               [MarshalAs(UnmanagedType.LPWStr)] string pattern, QueryFlags flags,
+                                               [Out] byte[] buffer, uint bufferSize, out uint entryCount,
+                                               out uint requiredSize);
+    }
+}
@@ -36,3 +36,60 @@ BOOL (WINAPI* TrueGetCurrentDirectoryW)(DWORD nBufferLength, LPWSTR buffer);
 
 HANDLE (WINAPI* TrueFindFirstFileExW)(LPCWSTR lpFileName, FINDEX_INFO_LEVELS fInfoLevelId, LPVOID lpFindFileData,
                                       FINDEX_SEARCH_OPS fSearchOp, LPVOID lpSearchFilter, DWORD dwAdditionalFlags);
+
+BOOL (WINAPI* TrueReadFile)(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead,
+                            LPOVERLAPPED lpOverlapped);
+
+DWORD (WINAPI* TrueSetFilePointer)(HANDLE hFile, LONG lDistanceToMove, PLONG lpDistanceToMoveHigh, DWORD dwMoveMethod);
+
+BOOL (WINAPI* TrueSetFilePointerEx)(HANDLE hFile, LARGE_INTEGER liDistanceToMove, PLARGE_INTEGER lpNewFilePointer,
+                                    DWORD dwMoveMethod);
+
+DWORD (WINAPI* TrueGetFileSize)(HANDLE hFile, LPDWORD lpFileSizeHigh);
+
+BOOL (WINAPI* TrueGetFileSizeEx)(HANDLE hFile, PLARGE_INTEGER lpFileSize);
+
+BOOL (WINAPI* TrueCloseHandle)(HANDLE hObject);
+
+HANDLE (WINAPI* TrueCreateFileMappingW)(HANDLE hFile, LPSECURITY_ATTRIBUTES lpFileMappingAttributes, DWORD flProtect,
+                                        DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, LPCWSTR lpName);
+
+BOOL (WINAPI* TrueGetFileInformationByHandle)(HANDLE hFile, LPBY_HANDLE_FILE_INFORMATION lpFileInformation);
+
+BOOL (WINAPI* TrueWriteFile)(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite,
+                             LPDWORD lpNumberOfBytesWritten, LPOVERLAPPED lpOverlapped);
+
+BOOL (WINAPI* TrueSetEndOfFile)(HANDLE hFile);
+
+DWORD (WINAPI* TrueGetFileType)(HANDLE hFile);
+
+BOOL (WINAPI* TrueFlushFileBuffers)(HANDLE hFile);
+
+BOOL (WINAPI* TrueGetFileTime)(HANDLE hFile, LPFILETIME lpCreationTime, LPFILETIME lpLastAccessTime,
+                               LPFILETIME lpLastWriteTime);
+
+// The class is an int, because FILE_INFO_BY_HANDLE_CLASS is only declared when targeting Vista or later
+BOOL (WINAPI* TrueGetFileInformationByHandleEx)(HANDLE hFile, int FileInformationClass, LPVOID lpFileInformation,
+                                                DWORD dwBufferSize);
+
+BOOL (WINAPI* TrueReadFileEx)(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPOVERLAPPED lpOverlapped,
+                              LPOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine);
+
+BOOL (WINAPI* TrueWriteFileEx)(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPOVERLAPPED lpOverlapped,
+                               LPOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine);
+
+BOOL (WINAPI* TrueLockFile)(HANDLE hFile, DWORD dwFileOffsetLow, DWORD dwFileOffsetHigh, DWORD nNumberOfBytesToLockLow,
+                            DWORD nNumberOfBytesToLockHigh);
+
+BOOL (WINAPI* TrueLockFileEx)(HANDLE hFile, DWORD dwFlags, DWORD dwReserved, DWORD nNumberOfBytesToLockLow,
+                              DWORD nNumberOfBytesToLockHigh, LPOVERLAPPED lpOverlapped);
+
+BOOL (WINAPI* TrueUnlockFile)(HANDLE hFile, DWORD dwFileOffsetLow, DWORD dwFileOffsetHigh,
+                              DWORD nNumberOfBytesToUnlockLow, DWORD nNumberOfBytesToUnlockHigh);
+
+BOOL (WINAPI* TrueUnlockFileEx)(HANDLE hFile, DWORD dwReserved, DWORD nNumberOfBytesToUnlockLow,
+                                DWORD nNumberOfBytesToUnlockHigh, LPOVERLAPPED lpOverlapped);
+
+BOOL (WINAPI* TrueDuplicateHandle)(HANDLE hSourceProcessHandle, HANDLE hSourceHandle, HANDLE hTargetProcessHandle,
+                                   LPHANDLE lpTargetHandle, DWORD dwDesiredAccess, BOOL bInheritHandle,
+                                   DWORD dwOptions);
@@ -0,0 +1,87 @@
+/*
+ * alloc_counter.h -- Heap allocation accounting for the hooks.
+ *
+ * VirtualFS replaces the global operator new with one that bumps a per-thread counter.
+ * hook_scope checks the allocations made during a single hook call against the budget of the call:
+ * passthrough calls may not allocate at all, and redirected calls may allocate at most once.
+ * Calls that change the tree (creating or removing entries) are not budgeted.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace vfs
+{
+	enum class hook_kind
+	{
+		passthrough,
+		redirected,
+		mutating
+	};
+
+	inline thread_local uint64_t ThreadAllocations = 0;
+	inline thread_local uint64_t LastHookAllocations = 0;
+	inline std::atomic<uint64_t> BudgetViolations{0};
+
+	// Tracks the allocations of a single hook call
+	class hook_scope
+	{
+	public:
+		hook_scope() : start_(ThreadAllocations)
+		{
+		}
+
+		~hook_scope()
+		{
+			const auto count = ThreadAllocations - start_;
+			LastHookAllocations = count;
+
+			if (kind_ != hook_kind::mutating && count > budget())
+				BudgetViolations.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		hook_scope(hook_scope const&) = delete;
+		hook_scope& operator=(hook_scope const&) = delete;
+
+		void set_kind(hook_kind kind)
+		{
+			kind_ = kind;
+		}
+
+		hook_kind kind() const
+		{
+			return kind_;
+		}
+
+	private:
+		uint64_t budget() const
+		{
+			return kind_ == hook_kind::passthrough ? 0 : 1;
+		}
+
+		uint64_t start_;
+		hook_kind kind_ = hook_kind::passthrough;
+	};
+
+	// Allocations made inside this scope are not charged to the hook (logging, lazy tree resolution)
+	class uncounted_scope
+	{
+	public:
+		uncounted_scope() : saved_(ThreadAllocations)
+		{
+		}
+
+		~uncounted_scope()
+		{
+			ThreadAllocations = saved_;
+		}
+
+		uncounted_scope(uncounted_scope const&) = delete;
+		uncounted_scope& operator=(uncounted_scope const&) = delete;
+
+	private:
+		uint64_t saved_;
+	};
+}
@@ -0,0 +1,167 @@
+/*
+ * batch_query.h -- Layouts of the batched query exports and the writer of packed tree listings.
+ *
+ * Managed code normally sees the VFS through hooked calls that System.IO makes one path at a time.
+ * vfs_resolve_paths resolves a whole list of paths in a single call, and vfs_list_tree writes a folder and everything
+ * under it into a buffer the caller owns. Each call works on a single snapshot of the tree.
+ *
+ * A packed listing is a sequence of 8-byte aligned entries in pre-order, so every folder comes before its contents.
+ * Each entry is a packed_entry followed by the name and the real path, neither of them terminated.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include "path_policy.h"
+#include "vfs_data.h"
+
+namespace vfs
+{
+	enum query_flags : uint32_t
+	{
+		QueryRealPaths = 1,  // Fill in the real paths of files
+		QueryAttributes = 2  // Fill in attributes, sizes and write times; costs a file system call per file
+	};
+
+	enum resolved_kind : uint32_t
+	{
+		ResolvedNone,  // Not in the VFS; calls on the path go to the path itself
+		ResolvedFile,
+		ResolvedFolder
+	};
+
+	static constexpr uint32_t no_string = 0xFFFFFFFF;
+	static constexpr uint32_t no_parent = 0xFFFFFFFF;
+
+	// Layout shared with vfs_resolve_paths
+	struct resolved_path
+	{
+		uint32_t kind;
+		uint32_t attributes;
+		uint64_t file_size;
+		uint64_t last_write_time;
+
+		// Offset of the real path in the string buffer in characters, or no_string
+		uint32_t real_path;
+		uint32_t real_path_length;
+	};
+
+	// Layout shared with vfs_list_tree
+	struct packed_entry
+	{
+		// Size of the entry with its strings, which is the offset to the next entry
+		uint32_t size;
+
+		// Index of the entry of the parent folder, or no_parent for the contents of the listed folder
+		uint32_t parent;
+
+		uint32_t attributes;
+		uint16_t name_length;
+		uint16_t real_path_length;
+		uint64_t file_size;
+		uint64_t last_write_time;
+	};
+
+	static_assert(sizeof(resolved_path) == 32 && sizeof(packed_entry) == 32, "Layouts are shared with managed code");
+
+	namespace details
+	{
+		// FILE_ATTRIBUTE_DIRECTORY and FILE_ATTRIBUTE_NORMAL, reported when attributes are not queried
+		static constexpr uint32_t directory_attributes = 0x10;
+		static constexpr uint32_t file_attributes = 0x80;
+	}
+
+	// Writes a packed listing into a buffer
+	// Entries are still counted once the buffer is full, so the caller learns how much space the listing needs
+	template <typename Policy>
+	class tree_packer
+	{
+	public:
+		using char_type = typename Policy::char_type;
+		using string_view = typename Policy::string_view;
+		using file_t = basic_vfs_file<Policy>;
+		using folder_t = basic_vfs_folder<Policy>;
+
+		tree_packer(void* buffer, size_t buffer_size, uint32_t flags)
+			: buffer_(static_cast<char*>(buffer)), buffer_size_(buffer_size), flags_(flags)
+		{
+		}
+
+		// Adds everything under the folder; files are only added if they match the pattern
+		// fill(object, entry) fills in the attributes, size and write time if they are queried
+		template <typename Fill>
+		void add_folder(folder_t& folder, string_view pattern, Fill& fill, uint32_t parent = no_parent)
+		{
+			for (auto& [name, object] : folder.get_contents())
+			{
+				if (object->is_file() && !match_pattern<Policy>(pattern, name))
+					continue;
+
+				string_view real_path;
+
+				if (object->is_file() && (flags_ & QueryRealPaths) != 0)
+					real_path = static_cast<file_t*>(object)->get_real_file();
+
+				const auto index = add(name, real_path, object, parent, fill);
+
+				if (object->is_folder())
+					add_folder(*static_cast<folder_t*>(object), pattern, fill, index);
+			}
+		}
+
+		uint32_t get_count() const
+		{
+			return count_;
+		}
+
+		size_t get_required_size() const
+		{
+			return required_size_;
+		}
+
+		bool fits() const
+		{
+			return required_size_ <= buffer_size_;
+		}
+
+	private:
+		template <typename Fill>
+		uint32_t add(string_view name, string_view real_path, basic_vfs_object<Policy>* object, uint32_t parent,
+		             Fill& fill)
+		{
+			const auto strings_size = (name.length() + real_path.length()) * sizeof(char_type);
+			const auto size = (sizeof(packed_entry) + strings_size + 7) & ~size_t(7);
+
+			// Once an entry does not fit, the rest are only counted
+			if (required_size_ + size <= buffer_size_)
+			{
+				const auto entry = reinterpret_cast<packed_entry*>(buffer_ + required_size_);
+				entry->size = static_cast<uint32_t>(size);
+				entry->parent = parent;
+				entry->attributes = object->is_folder() ? details::directory_attributes : details::file_attributes;
+				entry->name_length = static_cast<uint16_t>(name.length());
+				entry->real_path_length = static_cast<uint16_t>(real_path.length());
+				entry->file_size = 0;
+				entry->last_write_time = 0;
+
+				if ((flags_ & QueryAttributes) != 0)
+					fill(object, *entry);
+
+				const auto strings = reinterpret_cast<char*>(entry + 1);
+				memcpy(strings, name.data(), name.length() * sizeof(char_type));
+				memcpy(strings + name.length() * sizeof(char_type), real_path.data(),
+				       real_path.length() * sizeof(char_type));
+			}
+
+			required_size_ += size;
+			return count_++;
+		}
+
+		char* buffer_;
+		size_t buffer_size_;
+		uint32_t flags_;
+		size_t required_size_ = 0;
+		uint32_t count_ = 0;
+	};
+}
@@ -0,0 +1,180 @@
+/*
+ * listing_cache.h -- Cache of folder listings for file searches.
+ *
+ * The chainloader, the patcher loader and most plugins search the same folders with the same patterns
+ * many times while the game starts. A listing holds the indices of the children of a folder that match a pattern,
+ * so repeating a search costs a single probe of the cache plus iterating the listing.
+ *
+ * The cache has a fixed number of slots, addressed by a hash of the folder and the normalized pattern.
+ * A new listing simply replaces whatever was in its slot. Listings are tagged with the generation of their folder
+ * and are no longer used once the folder has changed. Search handles keep their own reference to their listing.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "alloc_counter.h"
+#include "memory_stats.h"
+#include "path_policy.h"
+#include "vfs_data.h"
+
+namespace vfs
+{
+	template <typename Policy>
+	struct listing
+	{
+		using string = typename Policy::string;
+
+		listing(void const* folder, uint64_t generation, string pattern)
+			: folder(folder), generation(generation), pattern(std::move(pattern))
+		{
+		}
+
+		~listing()
+		{
+			track_free(Caches, sizeof(listing) + string_bytes(pattern) + indices.capacity() * sizeof(uint32_t));
+		}
+
+		listing(listing const&) = delete;
+		listing& operator=(listing const&) = delete;
+
+		void const* folder;
+		uint64_t generation;
+		string pattern;
+		std::vector<uint32_t> indices;
+	};
+
+	template <typename Policy>
+	class listing_cache
+	{
+	public:
+		using folder_t = basic_vfs_folder<Policy>;
+		using listing_t = listing<Policy>;
+		using string = typename Policy::string;
+		using string_view = typename Policy::string_view;
+
+		struct statistics
+		{
+			uint64_t hits;
+			uint64_t misses;
+		};
+
+		// With no slots, every search gets a fresh listing
+		explicit listing_cache(size_t slot_count) : slots_(slot_count)
+		{
+		}
+
+		listing_cache(listing_cache const&) = delete;
+		listing_cache& operator=(listing_cache const&) = delete;
+
+		// Gets the children of the folder that match the pattern
+		std::shared_ptr<const listing_t> get(folder_t* folder, string_view pattern)
+		{
+			auto& contents = folder->get_contents();
+			const auto generation = folder->get_generation();
+			const auto hash = hash_key(folder, pattern);
+
+			if (!slots_.empty())
+			{
+				auto cached = std::atomic_load(&slots_[hash % slots_.size()]);
+
+				if (cached != nullptr && cached->folder == folder && cached->generation == generation &&
+					pattern_equal(cached->pattern, pattern))
+				{
+					hits_.fetch_add(1, std::memory_order_relaxed);
+					return cached;
+				}
+			}
+
+			misses_.fetch_add(1, std::memory_order_relaxed);
+
+			// Making a listing only happens on a miss, so it is not charged to the hook
+			uncounted_scope scope;
+
+			const auto result = std::make_shared<listing_t>(folder, generation, normalize(pattern));
+
+			uint32_t index = 0;
+			for (auto& entry : contents)
+			{
+				if (match_pattern<Policy>(pattern, entry.first))
+					result->indices.push_back(index);
+				index++;
+			}
+
+			result->indices.shrink_to_fit();
+			track_alloc(Caches, sizeof(listing_t) + string_bytes(result->pattern) +
+			            result->indices.capacity() * sizeof(uint32_t));
+
+			if (!slots_.empty())
+				std::atomic_store(&slots_[hash % slots_.size()], std::shared_ptr<const listing_t>(result));
+
+			return result;
+		}
+
+		statistics get_statistics() const
+		{
+			return {hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed)};
+		}
+
+	private:
+		// Patterns are compared case-folded (if the policy folds) and with runs of '*' collapsed,
+		// both of which match the same names
+		template <typename Function>
+		static void for_each_normalized(string_view pattern, Function function)
+		{
+			bool star = false;
+
+			for (const auto c : pattern)
+			{
+				if (c == '*' && star)
+					continue;
+
+				star = c == '*';
+				function(Policy::fold(c));
+			}
+		}
+
+		static string normalize(string_view pattern)
+		{
+			string result;
+			for_each_normalized(pattern, [&](auto c) { result.push_back(c); });
+			return result;
+		}
+
+		static bool pattern_equal(string const& normalized, string_view pattern)
+		{
+			size_t i = 0;
+			bool equal = true;
+
+			for_each_normalized(pattern, [&](auto c)
+			{
+				equal = equal && i < normalized.length() && normalized[i] == c;
+				i++;
+			});
+
+			return equal && i == normalized.length();
+		}
+
+		static size_t hash_key(folder_t const* folder, string_view pattern)
+		{
+			// FNV-1a over the folder address and the normalized pattern
+			uint64_t hash = 14695981039346656037ull ^ reinterpret_cast<uintptr_t>(folder);
+			hash *= 1099511628211ull;
+
+			for_each_normalized(pattern, [&](auto c)
+			{
+				hash ^= static_cast<std::make_unsigned_t<typename Policy::char_type>>(c);
+				hash *= 1099511628211ull;
+			});
+
+			return static_cast<size_t>(hash ^ hash >> 32);
+		}
+
+		std::vector<std::shared_ptr<const listing_t>> slots_;
+		std::atomic<uint64_t> hits_{0};
+		std::atomic<uint64_t> misses_{0};
+	};
+}
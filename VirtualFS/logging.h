@@ -3,6 +3,7 @@
 #include <windows.h>
 #include <fstream>
 #include <experimental/filesystem>
+#include "alloc_counter.h"
 #include "wideutils.h"
 
 
@@ -10,7 +11,8 @@
 
 static std::ofstream LogStream;
 
-#define LOG(msg) LogStream << msg << std::endl
+// Logging allocates, so it is not charged to the hook that logs
+#define LOG(msg) do { vfs::uncounted_scope _log_scope; LogStream << msg << std::endl; } while (0)
 #define N(str) narrow(str)
 
 inline void init_log(std::experimental::filesystem::path const& vfs_root)
@@ -0,0 +1,112 @@
+/*
+ * memory_stats.h -- Memory accounting of the VFS.
+ *
+ * Every subsystem that holds on to memory reports what it allocates and frees here.
+ * The counters are approximate (container overhead is estimated, not measured), but they are updated
+ * at the same places the memory is acquired and released, so live numbers return to zero once a tree is freed.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace vfs
+{
+	enum memory_subsystem
+	{
+		TreeNodes,      // vfs_file and vfs_folder objects
+		Names,          // Folder entries: names and their hashes
+		RealPaths,      // Paths to the real files and layer directories
+		SearchHandles,  // Open FindFirstFile searches
+		Caches,         // Lookup indexes and memoized proxy paths
+		MemoryFiles,    // Contents of new files kept in memory
+		SubsystemCount
+	};
+
+	// Layout shared with the exported query function
+	struct memory_usage
+	{
+		int64_t live_bytes;
+		int64_t peak_bytes;
+		int64_t live_objects;
+		int64_t peak_objects;
+	};
+
+	namespace details
+	{
+		inline void update_peak(std::atomic<int64_t>& peak, int64_t value)
+		{
+			auto current = peak.load(std::memory_order_relaxed);
+			while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		struct memory_counter
+		{
+			std::atomic<int64_t> live_bytes{0};
+			std::atomic<int64_t> peak_bytes{0};
+			std::atomic<int64_t> live_objects{0};
+			std::atomic<int64_t> peak_objects{0};
+		};
+
+		inline memory_counter MemoryCounters[SubsystemCount];
+	}
+
+	inline void track_alloc(memory_subsystem subsystem, size_t bytes, int64_t objects = 1)
+	{
+		auto& counter = details::MemoryCounters[subsystem];
+		const auto size = static_cast<int64_t>(bytes);
+		details::update_peak(counter.peak_bytes, counter.live_bytes.fetch_add(size, std::memory_order_relaxed) + size);
+		details::update_peak(counter.peak_objects,
+		                     counter.live_objects.fetch_add(objects, std::memory_order_relaxed) + objects);
+	}
+
+	inline void track_free(memory_subsystem subsystem, size_t bytes, int64_t objects = 1)
+	{
+		auto& counter = details::MemoryCounters[subsystem];
+		counter.live_bytes.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+		counter.live_objects.fetch_sub(objects, std::memory_order_relaxed);
+	}
+
+	// Bytes accounted for a string held by a subsystem
+	template <typename CharT>
+	size_t string_bytes(std::basic_string<CharT> const& str)
+	{
+		return (str.length() + 1) * sizeof(CharT);
+	}
+
+	inline memory_usage get_memory_usage(memory_subsystem subsystem)
+	{
+		auto& counter = details::MemoryCounters[subsystem];
+		return {
+			counter.live_bytes.load(std::memory_order_relaxed),
+			counter.peak_bytes.load(std::memory_order_relaxed),
+			counter.live_objects.load(std::memory_order_relaxed),
+			counter.peak_objects.load(std::memory_order_relaxed)
+		};
+	}
+
+	inline const char* get_subsystem_name(memory_subsystem subsystem)
+	{
+		switch (subsystem)
+		{
+		case TreeNodes:
+			return "tree_nodes";
+		case Names:
+			return "names";
+		case RealPaths:
+			return "real_paths";
+		case SearchHandles:
+			return "search_handles";
+		case Caches:
+			return "caches";
+		case MemoryFiles:
+			return "memory_files";
+		default:
+			return "unknown";
+		}
+	}
+}
@@ -0,0 +1,352 @@
+/*
+ * memory_store.h -- In-memory write-back store for small files.
+ *
+ * New files are kept in memory until they grow past the size limit, until they are flushed explicitly
+ * (on close, if the files are set to persist, and on shutdown) or until they are deleted.
+ * A file that is deleted before it is flushed never touches the disk.
+ *
+ * The store is portable: it does not know about handles or the Windows API.
+ * It does keep the access and sharing of the opens of each file, so that conflicting opens fail as they would on the disk.
+ * Writing flushed files to the disk is left to the writer function passed to the store.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "memory_stats.h"
+
+namespace vfs
+{
+	class memory_store
+	{
+	public:
+		struct file
+		{
+			std::wstring path;
+			std::vector<char> contents;
+			std::chrono::system_clock::time_point last_write_time;
+
+			// Set once the file has been written to the disk; the contents are gone from memory after that
+			bool flushed = false;
+
+			// Set once the file has been deleted; open handles can still use it, but it is never flushed
+			// It no longer counts towards the limit, and its contents are freed when the last open is closed
+			bool deleted = false;
+
+			// How many opens have, and how many share, each of the open flags
+			size_t opens = 0;
+			size_t accessing[3] = {};
+			size_t sharing[3] = {};
+		};
+
+		// Access and sharing flags of an open, with the meaning of the share modes of the file system
+		enum open_flags : unsigned
+		{
+			open_read = 1,
+			open_write = 2,
+			open_delete = 4
+		};
+
+		struct statistics
+		{
+			size_t files_in_memory;
+			size_t bytes_in_memory;
+			size_t files_flushed;
+			size_t files_discarded;
+		};
+
+		using writer = std::function<bool(std::wstring const& path, const char* data, size_t size)>;
+
+		memory_store(size_t max_file_size, size_t max_total_size, writer flush_writer)
+			: max_file_size_(max_file_size), max_total_size_(max_total_size), writer_(std::move(flush_writer))
+		{
+		}
+
+		memory_store(memory_store const&) = delete;
+		memory_store& operator=(memory_store const&) = delete;
+
+		// Creates an empty file, replacing the file with the same path
+		// Returns nullptr if the store is full
+		std::shared_ptr<file> create(std::wstring const& path)
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+
+			if (total_size_ >= max_total_size_)
+				return nullptr;
+
+			auto& entry = files_[path];
+
+			if (entry != nullptr)
+				discard(*entry);
+
+			entry = std::make_shared<file>();
+			entry->path = path;
+			track_alloc(MemoryFiles, 0);
+			entry->last_write_time = std::chrono::system_clock::now();
+			return entry;
+		}
+
+		std::shared_ptr<file> find(std::wstring const& path)
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+
+			const auto result = files_.find(path);
+			return result == files_.end() ? nullptr : result->second;
+		}
+
+		// Registers an open of the file
+		// Returns false if it conflicts with the access or the sharing of the opens before it
+		bool open(file& f, unsigned access, unsigned share)
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+
+			for (unsigned i = 0; i < 3; i++)
+			{
+				const auto flag = 1u << i;
+
+				if (((access & flag) != 0 && f.sharing[i] < f.opens) || ((share & flag) == 0 && f.accessing[i] != 0))
+					return false;
+			}
+
+			f.opens++;
+
+			for (unsigned i = 0; i < 3; i++)
+			{
+				f.accessing[i] += (access >> i) & 1;
+				f.sharing[i] += (share >> i) & 1;
+			}
+
+			return true;
+		}
+
+		// Unregisters an open made with the same flags
+		void close(file& f, unsigned access, unsigned share)
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+
+			f.opens--;
+
+			for (unsigned i = 0; i < 3; i++)
+			{
+				f.accessing[i] -= (access >> i) & 1;
+				f.sharing[i] -= (share >> i) & 1;
+			}
+
+			if (f.deleted && f.opens == 0)
+				release(f);
+		}
+
+		// Whether the file can be deleted, which every open of it has to share
+		// Files that are not in memory are left to the file system
+		bool can_delete(std::wstring const& path)
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+
+			const auto result = files_.find(path);
+			return result == files_.end() || result->second->sharing[2] == result->second->opens;
+		}
+
+		size_t read(file& f, uint64_t offset, void* buffer, size_t size)
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+
+			if (f.flushed || offset >= f.contents.size())
+				return 0;
+
+			const auto count = std::min<size_t>(size, f.contents.size() - static_cast<size_t>(offset));
+			memcpy(buffer, f.contents.data() + offset, count);
+			return count;
+		}
+
+		// Writes into the file
+		// Returns false if the file would grow past the limits; the caller has to flush it and write to the disk instead
+		bool write(file& f, uint64_t offset, const void* data, size_t size)
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+
+			if (f.flushed || offset + size > max_file_size_)
+				return false;
+
+			const auto end = static_cast<size_t>(offset) + size;
+
+			if (end > f.contents.size())
+			{
+				if (!f.deleted && total_size_ + (end - f.contents.size()) > max_total_size_)
+					return false;
+
+				account(f, end);
+				f.contents.resize(end);
+			}
+
+			memcpy(f.contents.data() + offset, data, size);
+			f.last_write_time = std::chrono::system_clock::now();
+			return true;
+		}
+
+		bool resize(file& f, uint64_t size)
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+
+			if (f.flushed || size > max_file_size_ ||
+				(!f.deleted && size > f.contents.size() && total_size_ + (size - f.contents.size()) > max_total_size_))
+				return false;
+
+			account(f, static_cast<size_t>(size));
+			f.contents.resize(static_cast<size_t>(size));
+			f.last_write_time = std::chrono::system_clock::now();
+			return true;
+		}
+
+		uint64_t size(file& f)
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+			return f.contents.size();
+		}
+
+		// Writes the file to the disk and drops it from memory
+		// Returns false if the file is deleted or could not be written; a file that could not be written stays in memory
+		bool flush(file& f)
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+			return flush_locked(f, writer_);
+		}
+
+		// Same as above, but writes the file with the given writer instead of the one of the store
+		bool flush(file& f, writer const& flush_writer)
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+			return flush_locked(f, flush_writer);
+		}
+
+		// Removes the file; returns false if it was not in memory
+		bool remove(std::wstring const& path)
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+
+			const auto result = files_.find(path);
+
+			if (result == files_.end())
+				return false;
+
+			discard(*result->second);
+			files_.erase(result);
+			return true;
+		}
+
+		// Paths of the files that are still in memory
+		std::vector<std::wstring> paths()
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+
+			std::vector<std::wstring> result;
+			result.reserve(files_.size());
+
+			for (auto& entry : files_)
+				result.push_back(entry.first);
+
+			return result;
+		}
+
+		// Flushes every file in memory
+		// Returns the paths of the files that could not be written, which are left in memory
+		std::vector<std::wstring> flush_all()
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+
+			// Flushing removes the files from the map
+			std::vector<std::shared_ptr<file>> files;
+			files.reserve(files_.size());
+
+			for (auto& entry : files_)
+				files.push_back(entry.second);
+
+			std::vector<std::wstring> failed;
+
+			for (auto& f : files)
+			{
+				if (!flush_locked(*f, writer_))
+					failed.push_back(f->path);
+			}
+
+			return failed;
+		}
+
+		statistics get_statistics()
+		{
+			std::lock_guard<std::mutex> lock(lock_);
+			return {files_.size(), total_size_, files_flushed_, files_discarded_};
+		}
+
+	private:
+		bool flush_locked(file& f, writer const& flush_writer)
+		{
+			if (f.flushed || f.deleted)
+				return f.flushed;
+
+			if (!flush_writer(f.path, f.contents.data(), f.contents.size()))
+				return false;
+
+			total_size_ -= f.contents.size();
+			release(f);
+			track_free(MemoryFiles, 0);
+			f.flushed = true;
+			files_flushed_++;
+
+			// The map might hold the last reference to the file
+			const auto entry = files_.find(f.path);
+			const auto keep_alive = entry->second;
+			files_.erase(entry);
+			return true;
+		}
+
+		// Deleted files no longer count towards the limit, even if they are still open
+		void account(file const& f, size_t new_size)
+		{
+			if (!f.deleted)
+				total_size_ = total_size_ - f.contents.size() + new_size;
+
+			if (new_size > f.contents.size())
+				track_alloc(MemoryFiles, new_size - f.contents.size(), 0);
+			else
+				track_free(MemoryFiles, f.contents.size() - new_size, 0);
+		}
+
+		// The contents stay until the last open is closed, so that handles opened with delete sharing can still read them
+		void discard(file& f)
+		{
+			total_size_ -= f.contents.size();
+			track_free(MemoryFiles, 0);
+			f.deleted = true;
+			files_discarded_++;
+
+			if (f.opens == 0)
+				release(f);
+		}
+
+		void release(file& f)
+		{
+			track_free(MemoryFiles, f.contents.size(), 0);
+			f.contents.clear();
+			f.contents.shrink_to_fit();
+		}
+
+		size_t max_file_size_;
+		size_t max_total_size_;
+		writer writer_;
+
+		std::mutex lock_;
+		std::unordered_map<std::wstring, std::shared_ptr<file>> files_;
+		size_t total_size_ = 0;
+		size_t files_flushed_ = 0;
+		size_t files_discarded_ = 0;
+	};
+}
@@ -0,0 +1,270 @@
+/*
+ * name_table.h -- Table of folder entries.
+ *
+ * Entries are kept in a plain array together with a parallel array of 32-bit name hashes, folded by the path policy.
+ * The full name comparison only happens when the hashes match.
+ *
+ * Small tables are scanned linearly (four hashes at a time with SSE2).
+ * Once a table grows past small_table_limit entries, an open-addressing index over the hashes is built
+ * so that lookups stay constant time no matter how many files a folder holds.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "memory_stats.h"
+#include "path_policy.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define VFS_NAME_TABLE_SSE2
+#endif
+
+namespace vfs
+{
+	template <typename T, typename Policy = ci_utf16>
+	class name_table
+	{
+	public:
+		using string = typename Policy::string;
+		using string_view = typename Policy::string_view;
+		using value_type = std::pair<string, T>;
+		using iterator = typename std::vector<value_type>::iterator;
+
+		static constexpr size_t npos = static_cast<size_t>(-1);
+		static constexpr size_t small_table_limit = 16;
+
+		name_table() = default;
+
+		~name_table()
+		{
+			clear();
+		}
+
+		name_table(name_table const&) = delete;
+		name_table& operator=(name_table const&) = delete;
+
+		iterator begin()
+		{
+			return entries_.begin();
+		}
+
+		iterator end()
+		{
+			return entries_.end();
+		}
+
+		size_t size() const
+		{
+			return entries_.size();
+		}
+
+		bool empty() const
+		{
+			return entries_.empty();
+		}
+
+		iterator find(string_view name)
+		{
+			const auto index = find_index(name, details::hash_name<Policy>(name));
+			return index == npos ? end() : begin() + index;
+		}
+
+		// Returns the entry with the given name, inserting an empty one if it does not exist
+		T& operator[](string_view name)
+		{
+			const auto hash = details::hash_name<Policy>(name);
+			auto index = find_index(name, hash);
+
+			if (index == npos)
+				index = insert(name, hash);
+
+			return entries_[index].second;
+		}
+
+		// Removes the entry by moving the last entry in its place
+		size_t erase(string_view name)
+		{
+			const auto index = find_index(name, details::hash_name<Policy>(name));
+
+			if (index == npos)
+				return 0;
+
+			const auto last = entries_.size() - 1;
+
+			track_free(Names, entry_bytes(entries_[index].first));
+
+			if (!slots_.empty())
+			{
+				remove_slot(index);
+				if (index != last)
+					*find_slot(last) = static_cast<uint32_t>(index + 1);
+			}
+
+			if (index != last)
+			{
+				entries_[index] = std::move(entries_[last]);
+				hashes_[index] = hashes_[last];
+			}
+
+			entries_.pop_back();
+			hashes_.pop_back();
+			return 1;
+		}
+
+		void clear()
+		{
+			for (auto& entry : entries_)
+				track_free(Names, entry_bytes(entry.first));
+
+			if (!slots_.empty())
+				track_free(Caches, slots_.size() * sizeof(uint32_t));
+
+			entries_.clear();
+			hashes_.clear();
+			slots_.clear();
+		}
+
+	private:
+		size_t find_index(string_view name, uint32_t hash) const
+		{
+			if (slots_.empty())
+				return scan(name, hash);
+
+			const auto mask = slots_.size() - 1;
+
+			for (auto slot = hash & mask;; slot = (slot + 1) & mask)
+			{
+				const auto value = slots_[slot];
+
+				if (value == 0)
+					return npos;
+
+				const auto index = value - 1;
+
+				if (hashes_[index] == hash && details::names_equal<Policy>(entries_[index].first, name))
+					return index;
+			}
+		}
+
+		size_t scan(string_view name, uint32_t hash) const
+		{
+			size_t i = 0;
+
+#ifdef VFS_NAME_TABLE_SSE2
+			const auto needle = _mm_set1_epi32(static_cast<int>(hash));
+
+			for (; i + 4 <= hashes_.size(); i += 4)
+			{
+				const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&hashes_[i]));
+				const auto mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(block, needle)));
+
+				if (mask == 0)
+					continue;
+
+				for (size_t bit = 0; bit < 4; bit++)
+				{
+					if (mask & (1 << bit) && details::names_equal<Policy>(entries_[i + bit].first, name))
+						return i + bit;
+				}
+			}
+#endif
+
+			for (; i < hashes_.size(); i++)
+			{
+				if (hashes_[i] == hash && details::names_equal<Policy>(entries_[i].first, name))
+					return i;
+			}
+
+			return npos;
+		}
+
+		size_t insert(string_view name, uint32_t hash)
+		{
+			const auto index = entries_.size();
+
+			entries_.emplace_back(string(name), T{});
+			hashes_.push_back(hash);
+
+			track_alloc(Names, entry_bytes(entries_[index].first));
+
+			if (entries_.size() * 2 > slots_.size() && entries_.size() > small_table_limit)
+				rebuild_index();
+			else if (!slots_.empty())
+				place(index);
+
+			return index;
+		}
+
+		void rebuild_index()
+		{
+			size_t capacity = 64;
+			while (capacity < entries_.size() * 2)
+				capacity *= 2;
+
+			if (!slots_.empty())
+				track_free(Caches, slots_.size() * sizeof(uint32_t));
+
+			slots_.assign(capacity, 0);
+			track_alloc(Caches, capacity * sizeof(uint32_t));
+
+			for (size_t i = 0; i < entries_.size(); i++)
+				place(i);
+		}
+
+		static size_t entry_bytes(string const& name)
+		{
+			return sizeof(value_type) + sizeof(uint32_t) + string_bytes(name);
+		}
+
+		void place(size_t index)
+		{
+			const auto mask = slots_.size() - 1;
+			auto slot = hashes_[index] & mask;
+
+			while (slots_[slot] != 0)
+				slot = (slot + 1) & mask;
+
+			slots_[slot] = static_cast<uint32_t>(index + 1);
+		}
+
+		uint32_t* find_slot(size_t index)
+		{
+			const auto mask = slots_.size() - 1;
+			auto slot = hashes_[index] & mask;
+
+			while (slots_[slot] != index + 1)
+				slot = (slot + 1) & mask;
+
+			return &slots_[slot];
+		}
+
+		// Backward-shift deletion, so that no tombstones are needed
+		void remove_slot(size_t index)
+		{
+			const auto mask = slots_.size() - 1;
+			auto hole = static_cast<size_t>(find_slot(index) - slots_.data());
+
+			for (auto next = (hole + 1) & mask; slots_[next] != 0; next = (next + 1) & mask)
+			{
+				const auto home = hashes_[slots_[next] - 1] & mask;
+
+				if (((next - home) & mask) >= ((next - hole) & mask))
+				{
+					slots_[hole] = slots_[next];
+					hole = next;
+				}
+			}
+
+			slots_[hole] = 0;
+		}
+
+		std::vector<value_type> entries_;
+		std::vector<uint32_t> hashes_;
+		std::vector<uint32_t> slots_;
+	};
+}
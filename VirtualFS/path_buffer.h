@@ -0,0 +1,158 @@
+/*
+ * path_buffer.h -- Allocation-free path handling for the hooks.
+ *
+ * Paths are built in fixed-size buffers on the stack and passed around as string views into them.
+ * Only paths that do not fit into the buffer fall back to the heap.
+ * Outside Windows only the buffer itself is available, so it can be tested without the API.
+ */
+
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <cwchar>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include "path_policy.h"
+
+namespace vfs
+{
+	class path_buffer
+	{
+	public:
+#ifdef _WIN32
+		static constexpr size_t capacity = MAX_PATH * 2;
+#else
+		static constexpr size_t capacity = 260 * 2;
+#endif
+
+		path_buffer()
+		{
+			buffer_[0] = L'\0';
+		}
+
+		path_buffer(path_buffer const&) = delete;
+		path_buffer& operator=(path_buffer const&) = delete;
+
+		// Replaces the contents with the concatenation of the parts
+		// The parts must not point into this buffer
+		path_buffer& assign(std::initializer_list<std::wstring_view> parts)
+		{
+			size_t length = 0;
+			for (auto& part : parts)
+				length += part.length();
+
+			auto out = reserve(length);
+			for (auto& part : parts)
+			{
+				wmemcpy(out, part.data(), part.length());
+				out += part.length();
+			}
+			*out = L'\0';
+
+			length_ = length;
+			return *this;
+		}
+
+#ifdef _WIN32
+		// Resolves the path to a full path the same way the file APIs do
+		bool assign_full_path(LPCWSTR path)
+		{
+			auto length = GetFullPathNameW(path, capacity, buffer_, nullptr);
+
+			if (length >= capacity)
+			{
+				// The returned length includes the null terminator if the buffer was too small
+				const auto size = length;
+				length = GetFullPathNameW(path, size, reserve(size - 1), nullptr);
+
+				if (length >= size)
+					return false;
+			}
+			else
+				on_heap_ = false;
+
+			if (length == 0)
+				return false;
+
+			length_ = length;
+			return true;
+		}
+#endif
+
+		void push_back(wchar_t c)
+		{
+			if (!on_heap_ && length_ + 1 < capacity)
+			{
+				buffer_[length_++] = c;
+				buffer_[length_] = L'\0';
+				return;
+			}
+
+			if (!on_heap_)
+			{
+				heap_.assign(buffer_, length_);
+				on_heap_ = true;
+			}
+
+			heap_.push_back(c);
+			length_++;
+		}
+
+		const wchar_t* c_str() const
+		{
+			return on_heap_ ? heap_.c_str() : buffer_;
+		}
+
+		wchar_t* data()
+		{
+			return on_heap_ ? &heap_[0] : buffer_;
+		}
+
+		size_t length() const
+		{
+			return length_;
+		}
+
+		bool empty() const
+		{
+			return length_ == 0;
+		}
+
+		wchar_t back() const
+		{
+			return c_str()[length_ - 1];
+		}
+
+		std::wstring_view view() const
+		{
+			return {c_str(), length_};
+		}
+
+		operator std::wstring_view() const
+		{
+			return view();
+		}
+
+	private:
+		wchar_t* reserve(size_t length)
+		{
+			if (length < capacity)
+			{
+				on_heap_ = false;
+				return buffer_;
+			}
+
+			heap_.resize(length);
+			on_heap_ = true;
+			return &heap_[0];
+		}
+
+		wchar_t buffer_[capacity];
+		std::wstring heap_;
+		size_t length_ = 0;
+		bool on_heap_ = false;
+	};
+}
@@ -0,0 +1,202 @@
+/*
+ * path_filter.h -- Bloom filter over every path in the VFS tree.
+ *
+ * Nearly all file calls the hooks see are for paths that are not in the VFS. The filter tells most of them apart
+ * in a few nanoseconds, so the tree is only walked for paths that are likely to be in it.
+ *
+ * The filter holds the path hashes of every file and folder (see details::hash_path_component),
+ * so the path to a folder doubles as the directory prefix of everything in it.
+ * Entries added to the tree are added to the filter. Removed entries stay in it, which only costs a walk that misses.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include "memory_stats.h"
+#include "path_policy.h"
+#include "vfs_data.h"
+
+namespace vfs
+{
+	template <typename Policy>
+	class path_filter
+	{
+	public:
+		using string_view = typename Policy::string_view;
+
+		static constexpr size_t bits_per_path = 10;
+		static constexpr size_t probes = 4;
+
+		// An empty filter lets every path through; used for trees that are resolved lazily
+		path_filter() = default;
+
+		explicit path_filter(size_t path_count)
+		{
+			size_t bits = 1024;
+			while (bits < path_count * bits_per_path)
+				bits *= 2;
+
+			allocate(bits / 64);
+		}
+
+		// Restores a filter from the words of another filter with the same policy
+		path_filter(uint64_t const* words, size_t word_count)
+		{
+			// The word count has to be a power of two for the mask to work
+			if (word_count == 0 || (word_count & (word_count - 1)) != 0)
+				return;
+
+			allocate(word_count);
+
+			for (size_t i = 0; i < word_count; i++)
+				words_[i].store(words[i], std::memory_order_relaxed);
+		}
+
+		~path_filter()
+		{
+			if (words_ != nullptr)
+				track_free(Caches, word_count_ * sizeof(uint64_t), 0);
+		}
+
+		path_filter(path_filter&& other) noexcept
+		{
+			*this = std::move(other);
+		}
+
+		path_filter& operator=(path_filter&& other) noexcept
+		{
+			if (words_ != nullptr)
+				track_free(Caches, word_count_ * sizeof(uint64_t), 0);
+
+			words_ = std::move(other.words_);
+			word_count_ = other.word_count_;
+			other.word_count_ = 0;
+			return *this;
+		}
+
+		bool enabled() const
+		{
+			return words_ != nullptr;
+		}
+
+		void add(uint64_t path_hash)
+		{
+			if (!enabled())
+				return;
+
+			for_each_bit(path_hash, [&](size_t word, uint64_t bit)
+			{
+				words_[word].fetch_or(bit, std::memory_order_relaxed);
+				return true;
+			});
+		}
+
+		// Adds every path under the folder
+		void add_tree(basic_vfs_folder<Policy>& folder)
+		{
+			for (auto& item : folder.get_contents())
+			{
+				add(details::hash_path_component<Policy>(folder.get_path_hash(), item.first));
+
+				if (item.second->is_folder())
+					add_tree(*static_cast<basic_vfs_folder<Policy>*>(item.second));
+			}
+		}
+
+		// Whether the path, relative to the folder with the given path hash, might be in the tree
+		// False means it definitely is not
+		bool may_contain(uint64_t root_hash, string_view path) const
+		{
+			if (!enabled())
+				return true;
+
+			const auto hash = hash_path(root_hash, path);
+
+			// The root itself is always there
+			return hash == root_hash || may_contain(hash);
+		}
+
+		// Whether a path with the given hash might have been added
+		bool may_contain(uint64_t path_hash) const
+		{
+			if (!enabled())
+				return true;
+
+			return for_each_bit(path_hash, [&](size_t word, uint64_t bit)
+			{
+				return (words_[word].load(std::memory_order_relaxed) & bit) != 0;
+			});
+		}
+
+		// Hashes a path relative to the folder with the given path hash
+		static uint64_t hash_path(uint64_t root_hash, string_view path)
+		{
+			basic_path_components<Policy> parts(path);
+			string_view part;
+			auto hash = root_hash;
+
+			while (parts.next(part))
+				hash = details::hash_path_component<Policy>(hash, part);
+
+			return hash;
+		}
+
+		size_t word_count() const
+		{
+			return word_count_;
+		}
+
+		uint64_t get_word(size_t index) const
+		{
+			return words_[index].load(std::memory_order_relaxed);
+		}
+
+		// Counts the paths under the folder, to size a filter for it
+		static size_t count_paths(basic_vfs_folder<Policy>& folder)
+		{
+			size_t count = 0;
+
+			for (auto& item : folder.get_contents())
+			{
+				count++;
+
+				if (item.second->is_folder())
+					count += count_paths(*static_cast<basic_vfs_folder<Policy>*>(item.second));
+			}
+
+			return count;
+		}
+
+	private:
+		void allocate(size_t word_count)
+		{
+			words_.reset(new std::atomic<uint64_t>[word_count]());
+			word_count_ = word_count;
+			track_alloc(Caches, word_count_ * sizeof(uint64_t), 0);
+		}
+
+		// Double hashing: the probes are spread by the upper half of the hash
+		template <typename Function>
+		bool for_each_bit(uint64_t hash, Function function) const
+		{
+			const auto mask = word_count_ * 64 - 1;
+			const auto step = (hash >> 32) | 1;
+
+			for (size_t i = 0; i < probes; i++)
+			{
+				const auto index = static_cast<size_t>(hash + i * step) & mask;
+
+				if (!function(index / 64, uint64_t(1) << (index % 64)))
+					return false;
+			}
+
+			return true;
+		}
+
+		std::unique_ptr<std::atomic<uint64_t>[]> words_;
+		size_t word_count_ = 0;
+	};
+}
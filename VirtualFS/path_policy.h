@@ -0,0 +1,267 @@
+/*
+ * path_policy.h -- Character type and case rules of the path engine.
+ *
+ * The name tables, the tree, the path splitter, the resolver and the pattern matcher are templates over a policy,
+ * so each combination is put together at compile time:
+ *
+ *   ci_utf16 -- wchar_t paths compared case-insensitively, the way Windows does it. Used by the hooks.
+ *   cs_utf8  -- char paths compared byte by byte, the way Linux does it. Names are never folded or transcoded.
+ *
+ * A policy supplies the character and string types, the path separator, the case folding used to hash and compare
+ * names, and the conversion from the UTF-8 strings stored in vfs.json.
+ */
+
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cwctype>
+#endif
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace vfs
+{
+	struct ci_utf16
+	{
+		using char_type = wchar_t;
+		using string = std::wstring;
+		using string_view = std::wstring_view;
+
+		static constexpr char_type separator = L'\\';
+		static constexpr bool case_sensitive = false;
+
+		// Folds a character to upper case the same way for hashing and comparing
+		static char_type fold(char_type c)
+		{
+			if (c < 0x80)
+				return c >= L'a' && c <= L'z' ? static_cast<wchar_t>(c - (L'a' - L'A')) : c;
+
+#ifdef _WIN32
+			// CharUpperW converts a single character if the high word of the pointer is zero
+			return static_cast<wchar_t>(reinterpret_cast<uintptr_t>(CharUpperW(
+				reinterpret_cast<LPWSTR>(static_cast<uintptr_t>(c)))));
+#else
+			return static_cast<wchar_t>(towupper(c));
+#endif
+		}
+
+		static string from_utf8(std::string const& str)
+		{
+#ifdef _WIN32
+			const auto length = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), str.length(), nullptr, 0);
+
+			if (length == 0)
+				return L"";
+
+			string result;
+			result.resize(length);
+			MultiByteToWideChar(CP_UTF8, 0, str.c_str(), str.length(), &result[0], length);
+			return result;
+#else
+			// wchar_t holds whole code points outside of Windows
+			string result;
+			result.reserve(str.length());
+
+			for (size_t i = 0; i < str.length();)
+			{
+				const auto c = static_cast<unsigned char>(str[i]);
+				const size_t length = c < 0x80 ? 1 : c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+				uint32_t code_point = length == 1 ? c : c & (0x7F >> length);
+
+				for (size_t j = 1; j < length && i + j < str.length(); j++)
+					code_point = code_point << 6 | (static_cast<unsigned char>(str[i + j]) & 0x3F);
+
+				result.push_back(static_cast<wchar_t>(code_point));
+				i += length;
+			}
+
+			return result;
+#endif
+		}
+	};
+
+	struct cs_utf8
+	{
+		using char_type = char;
+		using string = std::string;
+		using string_view = std::string_view;
+
+		static constexpr char_type separator = '/';
+		static constexpr bool case_sensitive = true;
+
+		static char_type fold(char_type c)
+		{
+			return c;
+		}
+
+		static string from_utf8(std::string const& str)
+		{
+			return str;
+		}
+	};
+
+	namespace details
+	{
+		// FNV-1a over the folded characters
+		template <typename Policy>
+		uint32_t hash_name(typename Policy::string_view name, uint32_t hash = 2166136261u)
+		{
+			using unsigned_char = std::make_unsigned_t<typename Policy::char_type>;
+
+			for (const auto c : name)
+			{
+				hash ^= static_cast<unsigned_char>(Policy::fold(c));
+				hash *= 16777619u;
+			}
+			return hash;
+		}
+
+		static constexpr uint64_t root_path_hash = 14695981039346656037ull;
+
+		// FNV-1a over the path of an entry: its parent's path hash, a separator and the folded name
+		// Paths that resolve to the same entry get the same hash, no matter the case or repeated separators
+		template <typename Policy>
+		uint64_t hash_path_component(uint64_t parent_hash, typename Policy::string_view name)
+		{
+			using unsigned_char = std::make_unsigned_t<typename Policy::char_type>;
+
+			auto hash = (parent_hash ^ static_cast<unsigned_char>(Policy::separator)) * 1099511628211ull;
+
+			for (const auto c : name)
+			{
+				hash ^= static_cast<unsigned_char>(Policy::fold(c));
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+
+		template <typename Policy>
+		bool chars_equal(typename Policy::char_type a, typename Policy::char_type b)
+		{
+			if constexpr (Policy::case_sensitive)
+				return a == b;
+			else
+				return a == b || Policy::fold(a) == Policy::fold(b);
+		}
+
+		template <typename Policy>
+		bool names_equal(typename Policy::string_view a, typename Policy::string_view b)
+		{
+			if constexpr (Policy::case_sensitive)
+				return a == b;
+			else
+			{
+				if (a.length() != b.length())
+					return false;
+
+				for (size_t i = 0; i < a.length(); i++)
+				{
+					if (!chars_equal<Policy>(a[i], b[i]))
+						return false;
+				}
+				return true;
+			}
+		}
+	}
+
+	// Case-insensitive (if the policy folds) prefix check that does not call into the OS
+	// Paths outside the prefix usually share its first folders (the drive, Program Files), so it is checked backwards
+	template <typename Policy>
+	bool starts_with(typename Policy::string_view str, typename Policy::string_view prefix)
+	{
+		if (str.length() < prefix.length())
+			return false;
+
+		for (auto i = prefix.length(); i-- > 0;)
+		{
+			if (!details::chars_equal<Policy>(str[i], prefix[i]))
+				return false;
+		}
+		return true;
+	}
+
+	// Match a name against common Windows globbing pattern
+	// This is O(nm) on average because of backtracking. Oh well
+	template <typename Policy>
+	bool match_pattern(typename Policy::string_view pattern, typename Policy::string_view str)
+	{
+		for (size_t i = 0; i < pattern.length(); i++)
+		{
+			switch (pattern[i])
+			{
+			case '?':
+				if (str.empty())
+					return false;
+				str.remove_prefix(1);
+				break;
+			case '*':
+				{
+					if (i + 1 == pattern.length())
+						return true;
+					for (size_t j = 0; j < str.length(); j++)
+						if (match_pattern<Policy>(pattern.substr(i + 1), str.substr(j)))
+							return true;
+					return false;
+				}
+			default:
+				if (str.empty() || !details::chars_equal<Policy>(str.front(), pattern[i]))
+					return false;
+				str.remove_prefix(1);
+			}
+		}
+		return str.empty();
+	}
+
+	// Iterates over the components of a separated path, skipping empty ones
+	template <typename Policy>
+	class basic_path_components
+	{
+	public:
+		using string_view = typename Policy::string_view;
+
+		explicit basic_path_components(string_view path) : rest_(path)
+		{
+		}
+
+		// Gets the next component; returns false once the path is exhausted
+		bool next(string_view& component)
+		{
+			while (!rest_.empty())
+			{
+				const auto index = rest_.find(Policy::separator);
+				component = rest_.substr(0, index);
+				rest_ = index == string_view::npos ? string_view() : rest_.substr(index + 1);
+
+				if (!component.empty())
+					return true;
+			}
+			return false;
+		}
+
+		// Whether there are no more components left
+		bool done() const
+		{
+			return rest_.find_first_not_of(Policy::separator) == string_view::npos;
+		}
+
+	private:
+		string_view rest_;
+	};
+
+	using path_components = basic_path_components<ci_utf16>;
+
+	// Split the last path separator and return a pair (path, file)
+	template <typename Policy = ci_utf16>
+	std::pair<typename Policy::string_view, typename Policy::string_view> split_last(typename Policy::string_view path)
+	{
+		const auto index = path.rfind(Policy::separator);
+		if (index == Policy::string_view::npos)
+			return {typename Policy::string_view(), path};
+		return {path.substr(0, index), path.substr(index + 1)};
+	}
+}
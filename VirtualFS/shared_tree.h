@@ -0,0 +1,130 @@
+/*
+ * shared_tree.h -- Read-only VFS tree shared between processes.
+ *
+ * The first process to build a tree writes it into a named shared memory section as an image:
+ * a single block with offsets in place of pointers, so every process can map it at a different address.
+ * Later processes that load the same vfs.json attach to the section read-only instead of parsing the tree again.
+ *
+ * The image is never written to after it is published. Each process copies the folders it actually visits
+ * into its own tree, which also holds everything the process changes (new files, deletes, proxy paths).
+ */
+
+#pragma once
+
+#include <windows.h>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "tree_image.h"
+
+namespace vfs
+{
+	// A published tree image mapped into this process
+	class shared_tree
+	{
+	public:
+		~shared_tree()
+		{
+			if (view_ != nullptr)
+				UnmapViewOfFile(view_);
+			if (section_ != nullptr)
+				CloseHandle(section_);
+		}
+
+		shared_tree(shared_tree const&) = delete;
+		shared_tree& operator=(shared_tree const&) = delete;
+
+		// Attaches to an image published by another process
+		// Returns nullptr if there is none or it is not complete yet
+		static std::unique_ptr<shared_tree> open(std::wstring const& name, uint64_t fingerprint)
+		{
+			const auto section = OpenFileMappingW(FILE_MAP_READ, FALSE, name.c_str());
+
+			if (section == nullptr)
+				return nullptr;
+
+			std::unique_ptr<shared_tree> tree(new shared_tree(section));
+			tree->view_ = static_cast<char*>(MapViewOfFile(section, FILE_MAP_READ, 0, 0, 0));
+
+			if (tree->view_ == nullptr)
+				return nullptr;
+
+			MEMORY_BASIC_INFORMATION info;
+
+			if (VirtualQuery(tree->view_, &info, sizeof(info)) == 0 || info.RegionSize < sizeof(image::header))
+				return nullptr;
+
+			const auto h = reinterpret_cast<const image::header*>(tree->view_);
+
+			if (h->ready.load(std::memory_order_acquire) != image::magic || h->version != image::version ||
+				h->fingerprint != fingerprint || h->size > info.RegionSize)
+				return nullptr;
+
+			tree->reader_ = image::reader(tree->view_, static_cast<size_t>(h->size));
+			return tree;
+		}
+
+		// Publishes an image for other processes
+		// Returns nullptr if another process already published (or is publishing) the same tree
+		static std::unique_ptr<shared_tree> publish(std::wstring const& name, std::vector<char> const& image)
+		{
+			const auto section = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+			                                        static_cast<DWORD>(static_cast<uint64_t>(image.size()) >> 32),
+			                                        static_cast<DWORD>(image.size()), name.c_str());
+
+			if (section == nullptr)
+				return nullptr;
+
+			std::unique_ptr<shared_tree> tree(new shared_tree(section));
+
+			if (GetLastError() == ERROR_ALREADY_EXISTS)
+				return nullptr;
+
+			const auto view = static_cast<char*>(MapViewOfFile(section, FILE_MAP_WRITE, 0, 0, image.size()));
+
+			if (view == nullptr)
+				return nullptr;
+
+			// Everything but the ready flag goes in first
+			memcpy(view + sizeof(uint32_t), image.data() + sizeof(uint32_t), image.size() - sizeof(uint32_t));
+			reinterpret_cast<image::header*>(view)->ready.store(image::magic, std::memory_order_release);
+
+			// The writable view is not needed anymore; the section lives as long as this process keeps it open
+			UnmapViewOfFile(view);
+
+			tree->reader_ = image::reader(nullptr, image.size());
+			return tree;
+		}
+
+		// Only attached trees can be read
+		bool is_attached() const
+		{
+			return view_ != nullptr;
+		}
+
+		image::reader const& get_reader() const
+		{
+			return reader_;
+		}
+
+		image::header const& get_header() const
+		{
+			return *reinterpret_cast<const image::header*>(view_);
+		}
+
+		size_t size() const
+		{
+			return reader_.size();
+		}
+
+	private:
+		explicit shared_tree(HANDLE section) : section_(section)
+		{
+		}
+
+		HANDLE section_;
+		char* view_ = nullptr;
+		image::reader reader_{nullptr, 0};
+	};
+}
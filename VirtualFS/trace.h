@@ -0,0 +1,209 @@
+/*
+ * trace.h -- Timeline recorder that writes Chrome/Perfetto trace-event JSON.
+ *
+ * Spans are recorded into a buffer that is allocated once when tracing is enabled,
+ * so recording a span never allocates. Once the buffer is full, further spans are dropped and counted.
+ * The buffer is written out as a single JSON file by flush().
+ *
+ * Init and reload phases are always recorded. Hook calls are sampled: only every sample_rate-th call on each thread is recorded.
+ */
+
+#pragma once
+
+#include <windows.h>
+#include <atomic>
+#include <cstdint>
+#include <experimental/filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "alloc_counter.h"
+
+namespace vfs
+{
+	namespace trace
+	{
+		// A single complete ("X") event
+		// All strings are string literals, so events can be copied around freely
+		struct event
+		{
+			const char* name;
+			const char* category;
+			const char* arg_name;
+			const char* arg_value;
+			int64_t start;
+			int64_t end;
+			DWORD thread_id;
+			std::atomic<bool> done;
+		};
+
+		static constexpr size_t buffer_size = 1 << 17;
+
+		inline bool Enabled = false;
+		inline uint32_t SampleRate = 1;
+		inline std::wstring OutputPath;
+		inline std::unique_ptr<event[]> Events;
+		inline std::atomic<size_t> EventCount{0};
+		inline int64_t StartTicks = 0;
+		inline int64_t TicksPerSecond = 1;
+		inline std::mutex FlushLock;
+		inline thread_local uint32_t HookCalls = 0;
+
+		inline int64_t now()
+		{
+			LARGE_INTEGER ticks;
+			QueryPerformanceCounter(&ticks);
+			return ticks.QuadPart;
+		}
+
+		// Starts recording; spans created before this are not recorded
+		inline void init(std::wstring const& output_path, uint32_t sample_rate)
+		{
+			LARGE_INTEGER frequency;
+			QueryPerformanceFrequency(&frequency);
+
+			OutputPath = output_path;
+			SampleRate = sample_rate == 0 ? 1 : sample_rate;
+			TicksPerSecond = frequency.QuadPart;
+			StartTicks = now();
+			Events.reset(new event[buffer_size]());
+			Enabled = true;
+		}
+
+		inline void record(const char* name, const char* category, const char* arg_name, const char* arg_value,
+		                   int64_t start, int64_t end)
+		{
+			const auto index = EventCount.fetch_add(1, std::memory_order_relaxed);
+
+			if (index >= buffer_size)
+				return;
+
+			auto& e = Events[index];
+			e.name = name;
+			e.category = category;
+			e.arg_name = arg_name;
+			e.arg_value = arg_value;
+			e.start = start;
+			e.end = end;
+			e.thread_id = GetCurrentThreadId();
+			e.done.store(true, std::memory_order_release);
+		}
+
+		inline int64_t to_microseconds(int64_t ticks)
+		{
+			return (ticks - StartTicks) * 1000000 / TicksPerSecond;
+		}
+
+		// Writes all recorded events into the output file
+		// Can be called several times; every call rewrites the file with everything recorded so far
+		inline void flush()
+		{
+			if (!Enabled)
+				return;
+
+			uncounted_scope scope;
+			std::lock_guard<std::mutex> lock(FlushLock);
+
+			std::ofstream stream(std::experimental::filesystem::path(OutputPath), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+
+			if (!stream.is_open())
+				return;
+
+			const auto count = EventCount.load(std::memory_order_relaxed);
+			const auto recorded = count < buffer_size ? count : buffer_size;
+			const auto process_id = GetCurrentProcessId();
+
+			stream << "{\"traceEvents\":[" << std::endl;
+			stream << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << process_id
+				<< ",\"args\":{\"name\":\"BepInVFS\"}}";
+
+			for (size_t i = 0; i < recorded; i++)
+			{
+				auto& e = Events[i];
+
+				if (!e.done.load(std::memory_order_acquire))
+					continue;
+
+				const auto start = to_microseconds(e.start);
+
+				stream << "," << std::endl << "{\"name\":\"" << e.name << "\",\"cat\":\"" << e.category
+					<< "\",\"ph\":\"X\",\"ts\":" << start << ",\"dur\":" << to_microseconds(e.end) - start
+					<< ",\"pid\":" << process_id << ",\"tid\":" << e.thread_id;
+
+				if (e.arg_name != nullptr)
+					stream << ",\"args\":{\"" << e.arg_name << "\":\"" << e.arg_value << "\"}";
+
+				stream << "}";
+			}
+
+			stream << std::endl << "],\"otherData\":{\"sample_rate\":" << SampleRate << ",\"dropped_events\":"
+				<< (count > buffer_size ? count - buffer_size : 0) << "}}" << std::endl;
+		}
+
+		// Records the lifetime of the object as a span
+		class span
+		{
+		public:
+			span(const char* name, const char* arg_name = nullptr, const char* arg_value = nullptr)
+				: name_(name), arg_name_(arg_name), arg_value_(arg_value), start_(Enabled ? now() : 0)
+			{
+			}
+
+			~span()
+			{
+				if (Enabled)
+					record(name_, "phase", arg_name_, arg_value_, start_, now());
+			}
+
+			span(span const&) = delete;
+			span& operator=(span const&) = delete;
+
+		private:
+			const char* name_;
+			const char* arg_name_;
+			const char* arg_value_;
+			int64_t start_;
+		};
+
+		// Records a sampled hook call, tagged with the outcome of the call
+		// Must be declared after the hook_scope of the call, so that the outcome is final when the span ends
+		class hook_span
+		{
+		public:
+			hook_span(const char* name, hook_scope const& scope)
+				: name_(name), scope_(scope), sampled_(Enabled && ++HookCalls % SampleRate == 0),
+				  start_(sampled_ ? now() : 0)
+			{
+			}
+
+			~hook_span()
+			{
+				if (sampled_)
+					record(name_, "hook", "outcome", outcome_name(scope_.kind()), start_, now());
+			}
+
+			hook_span(hook_span const&) = delete;
+			hook_span& operator=(hook_span const&) = delete;
+
+		private:
+			static const char* outcome_name(hook_kind kind)
+			{
+				switch (kind)
+				{
+				case hook_kind::redirected:
+					return "redirected";
+				case hook_kind::mutating:
+					return "mutating";
+				default:
+					return "passthrough";
+				}
+			}
+
+			const char* name_;
+			hook_scope const& scope_;
+			bool sampled_;
+			int64_t start_;
+		};
+	}
+}
@@ -0,0 +1,179 @@
+/*
+ * tree_image.h -- Position-independent image of a VFS tree.
+ *
+ * The image is a single block of memory with offsets in place of pointers, so it can be mapped at any address.
+ * Names and paths are stored in the character type of the tree's path policy.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+namespace vfs
+{
+	namespace image
+	{
+		static constexpr uint32_t magic = 0x53465642; // "BVFS"
+		static constexpr uint32_t version = 2;
+
+		// "ready" is set to magic only once the whole image has been written
+		struct header
+		{
+			std::atomic<uint32_t> ready;
+			uint32_t version;
+			uint64_t size;
+			uint64_t fingerprint;
+			uint32_t root;
+			uint32_t folder_count;
+
+			// Words of the tree's path filter (see path_filter.h); zero words if it has none
+			uint32_t filter;
+			uint32_t filter_words;
+		};
+
+		struct folder
+		{
+			uint32_t entry_count;
+			uint32_t entries;
+		};
+
+		enum entry_flags : uint32_t
+		{
+			IsFolder = 1,
+			IsPacked = 2
+		};
+
+		// A folder entry; target is the offset of a folder or a file record
+		struct entry
+		{
+			uint32_t name;
+			uint32_t name_length;
+			uint32_t flags;
+			uint32_t target;
+		};
+
+		struct file
+		{
+			uint32_t real_path;
+			uint32_t real_path_length;
+			uint32_t shared_path;
+			uint32_t shared_path_length;
+			uint64_t pack_offset;
+			uint64_t pack_size;
+		};
+
+		// Builds an image in private memory
+		class writer
+		{
+		public:
+			writer()
+			{
+				data_.resize(sizeof(header));
+			}
+
+			template <typename T>
+			uint32_t append(size_t count = 1)
+			{
+				align(alignof(T));
+				const auto offset = static_cast<uint32_t>(data_.size());
+				data_.resize(data_.size() + sizeof(T) * count);
+				return offset;
+			}
+
+			template <typename CharT>
+			uint32_t append_string(std::basic_string_view<CharT> str)
+			{
+				align(alignof(CharT));
+				const auto offset = static_cast<uint32_t>(data_.size());
+				data_.resize(data_.size() + str.length() * sizeof(CharT));
+				memcpy(data_.data() + offset, str.data(), str.length() * sizeof(CharT));
+				return offset;
+			}
+
+			// Only valid until the next append
+			template <typename T>
+			T& at(uint32_t offset)
+			{
+				return *reinterpret_cast<T*>(data_.data() + offset);
+			}
+
+			std::vector<char> const& finish(uint32_t root, uint32_t folder_count, uint32_t filter, uint32_t filter_words,
+			                                uint64_t fingerprint)
+			{
+				auto& h = at<header>(0);
+				h.version = version;
+				h.size = data_.size();
+				h.fingerprint = fingerprint;
+				h.root = root;
+				h.folder_count = folder_count;
+				h.filter = filter;
+				h.filter_words = filter_words;
+				return data_;
+			}
+
+		private:
+			void align(size_t alignment)
+			{
+				data_.resize((data_.size() + alignment - 1) & ~(alignment - 1));
+			}
+
+			std::vector<char> data_;
+		};
+
+		// Reads a published image
+		// The section could have been created by anything, so every offset is checked before it is used
+		class reader
+		{
+		public:
+			reader(const char* base, size_t size) : base_(base), size_(size)
+			{
+			}
+
+			template <typename T>
+			const T* get(uint32_t offset, size_t count = 1) const
+			{
+				if (offset % alignof(T) != 0 || offset > size_ || (size_ - offset) / sizeof(T) < count)
+					return nullptr;
+
+				return reinterpret_cast<const T*>(base_ + offset);
+			}
+
+			template <typename CharT>
+			bool get_string(uint32_t offset, uint32_t length, std::basic_string_view<CharT>& result) const
+			{
+				const auto str = get<CharT>(offset, length);
+
+				if (str == nullptr)
+					return false;
+
+				result = std::basic_string_view<CharT>(str, length);
+				return true;
+			}
+
+			size_t size() const
+			{
+				return size_;
+			}
+
+		private:
+			const char* base_;
+			size_t size_;
+		};
+
+		// FNV-1a over the bytes of the value
+		inline uint64_t fingerprint(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+		{
+			for (size_t i = 0; i < size; i++)
+			{
+				hash ^= static_cast<const unsigned char*>(data)[i];
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+	}
+
+}
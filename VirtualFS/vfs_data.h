@@ -6,15 +6,27 @@
  * The parser can only handle objects and string values (which is enough for our case anyway).
  * No caching, everything is parsed into memory at once.
  * 
- * The JSON parser reads a normal UTF-8 file (as a ifstream, not wifstream) and converts all char strings
- * to wchar strings via codecvt.
+ * The JSON parser reads a normal UTF-8 file (as a ifstream, not wifstream) and converts all strings
+ * to the string type of the path policy (see path_policy.h).
+ *
+ * Alternatively, folders can be backed by a list of real directories (layers) or by a folder of a tree image
+ * shared by another process. Contents of such folders are resolved the first time they are accessed.
  */
 
 #pragma once
 
+#include <atomic>
+#include <cwctype>
 #include <map>
+#include <mutex>
 #include <sstream>
-#include "wideutils.h"
+#include <string_view>
+#include <vector>
+#include "alloc_counter.h"
+#include "memory_stats.h"
+#include "name_table.h"
+#include "path_policy.h"
+#include "tree_image.h"
 
 namespace vfs
 {
@@ -45,7 +57,8 @@ namespace vfs
 			return false;
 		}
 
-		inline std::wstring read_until(std::istream& stream, char ch)
+		template <typename Policy>
+		typename Policy::string read_until(std::istream& stream, char ch)
 		{
 			std::stringbuf buf;
 			bool is_escape = false;
@@ -90,7 +103,7 @@ namespace vfs
 
 				buf.sputc(c);
 			}
-			return widen(buf.str());
+			return Policy::from_utf8(buf.str());
 		}
 
 		inline bool skip_whitespace(std::istream& stream)
@@ -105,13 +118,32 @@ namespace vfs
 			return false;
 		}
 
-		struct wstr_comp_ci
+		template <typename Policy>
+		struct directory_entry
 		{
-			bool operator()(const std::wstring& s1, const std::wstring& s2) const
-			{
-				return CompareStringW(LOCALE_INVARIANT, NORM_IGNORECASE, s1.c_str(), -1, s2.c_str(), -1) == CSTR_LESS_THAN;
-			}
+			typename Policy::string name;
+			bool is_folder;
 		};
+
+		// Lists the contents of a real directory
+		// Implemented by the hook layer for each policy it uses, because it has to bypass the hooks
+		template <typename Policy>
+		std::vector<directory_entry<Policy>> list_directory(typename Policy::string const& path);
+
+		// Source of folder generations; never reused, so a folder allocated at the address of a deleted one
+		// cannot be mistaken for it
+		inline std::atomic<uint64_t> NextGeneration{1};
+
+		template <typename CharT>
+		uint64_t parse_number(std::basic_string_view<CharT> str, size_t& index)
+		{
+			uint64_t result = 0;
+
+			for (; index < str.length() && str[index] >= '0' && str[index] <= '9'; index++)
+				result = result * 10 + (str[index] - '0');
+
+			return result;
+		}
 	}
 
 	// A helper to easily distiguish a type of VFS object
@@ -124,10 +156,11 @@ namespace vfs
 	};
 
 	// A common VFS object
-	class vfs_object
+	template <typename Policy>
+	class basic_vfs_object
 	{
 	public:
-		virtual ~vfs_object()
+		virtual ~basic_vfs_object()
 		{
 			parent = nullptr;
 		}
@@ -142,12 +175,12 @@ namespace vfs
 			return type_ == File;
 		}
 
-		vfs_object* get_parent() const
+		basic_vfs_object* get_parent() const
 		{
 			return parent;
 		}
 
-		void set_parent(vfs_object* new_parent)
+		void set_parent(basic_vfs_object* new_parent)
 		{
 			parent = new_parent;
 		}
@@ -155,59 +188,277 @@ namespace vfs
 	protected:
 		VFSObjectType type_ = None;
 
-		vfs_object* parent = nullptr;
+		basic_vfs_object* parent = nullptr;
 	};
 
 	// A VFS file. Contains a path to the original file.
-	class vfs_file : public vfs_object
+	// Files deduplicated by the launcher also contain the path to a canonical file with the same contents,
+	// and files stored in the pack contain their region in the pack
+	template <typename Policy>
+	class basic_vfs_file : public basic_vfs_object<Policy>
 	{
 	public:
-		vfs_file(const std::wstring str)
+		using string = typename Policy::string;
+
+		basic_vfs_file(const string str, const string shared_str = string())
 		{
-			type_ = File;
+			this->type_ = File;
 			original_file = str;
+			shared_file = shared_str;
+
+			track_alloc(TreeNodes, sizeof(basic_vfs_file));
+			track_alloc(RealPaths, string_bytes(original_file) + string_bytes(shared_file));
 		}
 
-		std::wstring& get_real_file()
+		virtual ~basic_vfs_file()
+		{
+			track_free(TreeNodes, sizeof(basic_vfs_file));
+			track_free(RealPaths, string_bytes(original_file) + string_bytes(shared_file));
+		}
+
+		string const& get_real_file() const
 		{
 			return original_file;
 		}
 
+		// Empty unless the launcher found another file with the same contents
+		string const& get_shared_file() const
+		{
+			return shared_file;
+		}
+
+		// The file to use for opens that cannot modify the file
+		string const& get_read_file() const
+		{
+			return shared_file.empty() ? original_file : shared_file;
+		}
+
+		bool is_packed() const
+		{
+			return packed;
+		}
+
+		uint64_t get_pack_offset() const
+		{
+			return pack_offset;
+		}
+
+		uint64_t get_pack_size() const
+		{
+			return pack_size;
+		}
+
+		void set_pack_region(uint64_t offset, uint64_t size)
+		{
+			packed = true;
+			pack_offset = offset;
+			pack_size = size;
+		}
+
 	private:
-		std::wstring original_file;
+		string original_file;
+		string shared_file;
+		bool packed = false;
+		uint64_t pack_offset = 0;
+		uint64_t pack_size = 0;
 	};
 
-	// VFS Folder. Contains a case-insensitive map of VFS objects
-	class vfs_folder : public vfs_object
+	namespace details
+	{
+		// Parses a file entry of the tree
+		// Deduplicated files are stored as "original|canonical" and packed files as "original|*offset:size"
+		// A packed deduplicated file keeps its canonical copy: "original|canonical|*offset:size"
+		// Neither '|' nor '*' can appear in a path
+		template <typename Policy>
+		basic_vfs_file<Policy>* parse_file(typename Policy::string const& value)
+		{
+			const auto separator = value.find('|');
+
+			if (separator == Policy::string::npos)
+				return new basic_vfs_file<Policy>(value);
+
+			const auto region_start = value.find('*', separator + 1);
+			const auto shared_end = region_start == Policy::string::npos ? value.length() : region_start - 1;
+			const auto shared = shared_end > separator + 1
+				                    ? value.substr(separator + 1, shared_end - separator - 1)
+				                    : typename Policy::string();
+
+			if (region_start == Policy::string::npos)
+				return new basic_vfs_file<Policy>(value.substr(0, separator), shared);
+
+			const typename Policy::string_view region(value);
+			auto index = region_start + 1;
+			const auto offset = parse_number(region, index);
+			index++;
+			const auto size = parse_number(region, index);
+
+			const auto file = new basic_vfs_file<Policy>(value.substr(0, separator), shared);
+			file->set_pack_region(offset, size);
+			return file;
+		}
+	}
+
+	// VFS Folder. Contains a table of VFS objects, compared by the rules of the path policy
+	template <typename Policy>
+	class basic_vfs_folder : public basic_vfs_object<Policy>
 	{
 	public:
-		using folder_t = std::map<std::wstring, vfs_object*, details::wstr_comp_ci>;
+		using object_t = basic_vfs_object<Policy>;
+		using file_t = basic_vfs_file<Policy>;
+		using folder_t = name_table<object_t*, Policy>;
+		using string = typename Policy::string;
+		using string_view = typename Policy::string_view;
 
-		vfs_folder()
+		basic_vfs_folder()
 		{
-			type_ = Folder;
+			this->type_ = Folder;
+
+			track_alloc(TreeNodes, sizeof(basic_vfs_folder));
 		}
 
-		virtual ~vfs_folder()
+		virtual ~basic_vfs_folder()
 		{
-			for (auto v : contents_)
+			for (auto& v : contents_)
 			{
 				delete v.second;
 			}
 			contents_.clear();
+
+			set_proxy_path(string());
+			clear_layers();
+
+			track_free(TreeNodes, sizeof(basic_vfs_folder));
 		}
 
 		folder_t& get_contents()
 		{
+			std::call_once(resolved_, &basic_vfs_folder::resolve, this);
 			return contents_;
 		}
 
+		// Changes every time an entry is added to or removed from the folder
+		uint64_t get_generation() const
+		{
+			return generation_.load(std::memory_order_acquire);
+		}
+
+		// Has to be called by everything that adds or removes entries
+		void bump_generation()
+		{
+			generation_.store(details::NextGeneration.fetch_add(1, std::memory_order_relaxed), std::memory_order_release);
+		}
+
+		// Hash of the path from the root of the tree to this folder (see details::hash_path_component)
+		uint64_t get_path_hash() const
+		{
+			return path_hash_;
+		}
+
+		// Places a new folder into this one under the given name
+		void adopt(basic_vfs_folder* folder, string_view name)
+		{
+			folder->set_parent(this);
+			folder->path_hash_ = details::hash_path_component<Policy>(path_hash_, name);
+		}
+
+		// Adds a real directory whose contents are overlaid on top of this folder
+		// Later layers override files from the earlier ones; folders are merged
+		void add_layer(string const& path)
+		{
+			layers_.push_back({path, string()});
+			track_alloc(RealPaths, string_bytes(path));
+		}
+
+		// Adds a real directory as a layer that is overlaid as the given subfolder
+		void add_layer(string const& path, string const& mount_name)
+		{
+			layers_.push_back({path, mount_name});
+			track_alloc(RealPaths, string_bytes(path));
+		}
+
+		// Backs the folder with a folder of a tree image, which has to outlive this folder
+		void attach_image(image::reader const* reader, uint32_t folder)
+		{
+			image_ = reader;
+			image_folder_ = folder;
+		}
+
+		// Writes the folder and everything in it into a tree image and returns the offset of the folder
+		uint32_t write_image(image::writer& writer, uint32_t& folder_count)
+		{
+			auto& contents = get_contents();
+
+			const auto offset = writer.append<image::folder>();
+			const auto entries = writer.append<image::entry>(contents.size());
+			writer.at<image::folder>(offset) = {static_cast<uint32_t>(contents.size()), entries};
+			folder_count++;
+
+			uint32_t index = 0;
+			for (auto& item : contents)
+			{
+				const auto name = writer.append_string(string_view(item.first));
+				uint32_t flags = 0;
+				uint32_t target;
+
+				if (item.second->is_folder())
+				{
+					flags = image::IsFolder;
+					target = static_cast<basic_vfs_folder*>(item.second)->write_image(writer, folder_count);
+				}
+				else
+				{
+					const auto file = static_cast<file_t*>(item.second);
+					const auto real_path = writer.append_string(string_view(file->get_real_file()));
+					const auto shared_path = writer.append_string(string_view(file->get_shared_file()));
+
+					if (file->is_packed())
+						flags = image::IsPacked;
+
+					target = writer.append<image::file>();
+					writer.at<image::file>(target) = {
+						real_path, static_cast<uint32_t>(file->get_real_file().length()),
+						shared_path, static_cast<uint32_t>(file->get_shared_file().length()),
+						file->get_pack_offset(), file->get_pack_size()
+					};
+				}
+
+				writer.at<image::entry>(entries + index++ * sizeof(image::entry)) = {
+					name, static_cast<uint32_t>(item.first.length()), flags, target
+				};
+			}
+
+			return offset;
+		}
+
+		// Path to the folder's proxy directory in the temp folder
+		// Empty until the directory has been physically created
+		string const& get_proxy_path() const
+		{
+			return proxy_path_;
+		}
+
+		bool has_proxy_path() const
+		{
+			return !proxy_path_.empty();
+		}
+
+		void set_proxy_path(string const& path)
+		{
+			if (has_proxy_path())
+				track_free(Caches, string_bytes(proxy_path_));
+
+			proxy_path_ = path;
+
+			if (has_proxy_path())
+				track_alloc(Caches, string_bytes(proxy_path_));
+		}
+
 		// Parses the provided stream into a VFS folder
 		// We use a simlified FSM with the help of gotos (I know, shame on me; didn't bother with proper states)
 		void parse(std::istream& stream)
 		{
-			vfs_folder* new_folder;
-			vfs_file* new_file;
+			basic_vfs_folder* new_folder;
+			file_t* new_file;
 			auto folder = this;
 
 			while (true)
@@ -222,7 +473,7 @@ namespace vfs
 					if (!details::skip_until(stream, '"'))
 						return;
 
-					const auto key = details::read_until(stream, '"');
+					const auto key = details::read_until<Policy>(stream, '"');
 
 					if (!details::skip_until(stream, ':') || !details::skip_whitespace(stream))
 						return;
@@ -230,14 +481,14 @@ namespace vfs
 					switch (stream.peek())
 					{
 					case '{':
-						new_folder = new vfs_folder;
+						new_folder = new basic_vfs_folder;
 						folder->contents_[key] = new_folder;
-						new_folder->parent = folder;
+						folder->adopt(new_folder, key);
 						folder = new_folder;
 						goto folder_start;
 					case '"':
 						stream.get();
-						new_file = new vfs_file(details::read_until(stream, '"'));
+						new_file = details::parse_file<Policy>(details::read_until<Policy>(stream, '"'));
 						new_file->set_parent(folder);
 						folder->contents_[key] = new_file;
 						break;
@@ -254,7 +505,7 @@ namespace vfs
 
 				if (folder->parent != nullptr)
 				{
-					folder = dynamic_cast<vfs_folder*>(folder->parent);
+					folder = dynamic_cast<basic_vfs_folder*>(folder->parent);
 
 					if (!details::skip_until_block(stream, ',', '}') || !details::skip_whitespace(stream))
 						return;
@@ -266,6 +517,158 @@ namespace vfs
 		}
 
 	private:
+		// Populates the folder from its layers
+		// This only happens once per folder, so it is not charged to the hook that triggered it
+		void resolve()
+		{
+			uncounted_scope scope;
+
+			if (image_ != nullptr)
+				resolve_image();
+
+			for (auto& layer : layers_)
+			{
+				const auto entries = layer.mount_name.empty()
+					                     ? details::list_directory<Policy>(layer.path)
+					                     : std::vector<details::directory_entry<Policy>>{{layer.mount_name, true}};
+
+				for (auto& entry : entries)
+				{
+					const auto real_path = layer.mount_name.empty() ? layer.path + Policy::separator + entry.name : layer.path;
+					auto& item = contents_[entry.name];
+
+					if (entry.is_folder && item != nullptr && item->is_folder())
+					{
+						static_cast<basic_vfs_folder*>(item)->add_layer(real_path);
+						continue;
+					}
+
+					delete item;
+
+					if (entry.is_folder)
+					{
+						const auto new_folder = new basic_vfs_folder;
+						new_folder->add_layer(real_path);
+						adopt(new_folder, entry.name);
+						item = new_folder;
+					}
+					else
+						item = new file_t(real_path);
+
+					item->set_parent(this);
+				}
+			}
+
+			clear_layers();
+		}
+
+		// Copies the folder out of the shared image; its subfolders stay in the image until they are accessed
+		void resolve_image()
+		{
+			auto& reader = *image_;
+			const auto folder = reader.get<image::folder>(image_folder_);
+			const auto entries = folder != nullptr ? reader.get<image::entry>(folder->entries, folder->entry_count) : nullptr;
+
+			if (entries != nullptr)
+			{
+				for (uint32_t i = 0; i < folder->entry_count; i++)
+				{
+					auto& entry = entries[i];
+					string_view name;
+
+					if (!reader.get_string(entry.name, entry.name_length, name))
+						continue;
+
+					object_t* item;
+
+					if (entry.flags & image::IsFolder)
+					{
+						const auto new_folder = new basic_vfs_folder;
+						new_folder->attach_image(image_, entry.target);
+						adopt(new_folder, name);
+						item = new_folder;
+					}
+					else
+					{
+						const auto file = reader.get<image::file>(entry.target);
+						string_view real_path, shared_path;
+
+						if (file == nullptr || !reader.get_string(file->real_path, file->real_path_length, real_path) ||
+							!reader.get_string(file->shared_path, file->shared_path_length, shared_path))
+							continue;
+
+						const auto new_file = new file_t(string(real_path), string(shared_path));
+
+						if (entry.flags & image::IsPacked)
+							new_file->set_pack_region(file->pack_offset, file->pack_size);
+
+						item = new_file;
+					}
+
+					item->set_parent(this);
+
+					auto& slot = contents_[name];
+					delete slot;
+					slot = item;
+				}
+			}
+
+			image_ = nullptr;
+		}
+
+		void clear_layers()
+		{
+			for (auto& layer : layers_)
+				track_free(RealPaths, string_bytes(layer.path));
+
+			layers_.clear();
+			layers_.shrink_to_fit();
+		}
+
+		struct layer
+		{
+			string path;
+			string mount_name;
+		};
+
 		folder_t contents_;
+		string proxy_path_;
+		std::vector<layer> layers_;
+		image::reader const* image_ = nullptr;
+		uint32_t image_folder_ = 0;
+		std::once_flag resolved_;
+		std::atomic<uint64_t> generation_{details::NextGeneration.fetch_add(1, std::memory_order_relaxed)};
+		uint64_t path_hash_ = details::root_path_hash;
 	};
+
+	// Walks the tree along the path
+	// Returns the file or folder the path leads to, or nullptr if there is none
+	template <typename Policy>
+	basic_vfs_object<Policy>* resolve_path(typename Policy::string_view path, basic_vfs_object<Policy>* root)
+	{
+		basic_path_components<Policy> parts(path);
+		typename Policy::string_view part;
+
+		auto p = root;
+
+		while (parts.next(part))
+		{
+			if (p->is_file())
+				return nullptr;
+
+			auto& folder_contents = static_cast<basic_vfs_folder<Policy>*>(p)->get_contents();
+			const auto result = folder_contents.find(part);
+
+			if (result == folder_contents.end())
+				return nullptr;
+
+			p = result->second;
+		}
+
+		return p;
+	}
+
+	using vfs_object = basic_vfs_object<ci_utf16>;
+	using vfs_file = basic_vfs_file<ci_utf16>;
+	using vfs_folder = basic_vfs_folder<ci_utf16>;
 }
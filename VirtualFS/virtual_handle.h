@@ -0,0 +1,136 @@
+/*
+ * virtual_handle.h -- File handles whose contents are not served by the file system directly.
+ *
+ * The caller gets a real kernel handle, so calls that are not hooked fail gracefully instead of crashing.
+ * The hooked file APIs look the handle up in the registry and let the virtual handle serve the call.
+ * Anything a virtual handle cannot serve itself (overlapped I/O, mappings, file information, times, locks,
+ * duplication) is passed on to the real file it stands for.
+ *
+ * Only the kernel32 exports are hooked. Code that calls ntdll or kernelbase directly with a virtual handle
+ * acts on the placeholder handle: the whole pack for packed files, or an event for in-memory files.
+ */
+
+#pragma once
+
+#include <windows.h>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace vfs
+{
+	class virtual_handle
+	{
+	public:
+		explicit virtual_handle(HANDLE handle) : handle_(handle)
+		{
+		}
+
+		virtual ~virtual_handle() = default;
+
+		virtual_handle(virtual_handle const&) = delete;
+		virtual_handle& operator=(virtual_handle const&) = delete;
+
+		HANDLE get_handle() const
+		{
+			return handle_;
+		}
+
+		// Reads at the current position and advances it
+		virtual BOOL read(void* buffer, DWORD size, DWORD* read) = 0;
+
+		// Writes at the current position and advances it
+		virtual BOOL write(const void* buffer, DWORD size, DWORD* written) = 0;
+
+		virtual uint64_t size() = 0;
+
+		// Truncates or extends the file to the current position
+		virtual BOOL set_end_of_file() = 0;
+
+		// Gets a handle to the real file for the calls the virtual handle cannot serve
+		virtual HANDLE get_real_handle() = 0;
+
+		// Releases everything the handle holds, including the handle given to the caller
+		virtual BOOL close() = 0;
+
+		bool seek(LONGLONG distance, DWORD move_method)
+		{
+			LONGLONG base;
+
+			switch (move_method)
+			{
+			case FILE_BEGIN:
+				base = 0;
+				break;
+			case FILE_CURRENT:
+				base = static_cast<LONGLONG>(position_);
+				break;
+			case FILE_END:
+				base = static_cast<LONGLONG>(size());
+				break;
+			default:
+				SetLastError(ERROR_INVALID_PARAMETER);
+				return false;
+			}
+
+			if (base + distance < 0)
+			{
+				SetLastError(ERROR_NEGATIVE_SEEK);
+				return false;
+			}
+
+			position_ = static_cast<uint64_t>(base + distance);
+			return true;
+		}
+
+		uint64_t get_position() const
+		{
+			return position_;
+		}
+
+	protected:
+		HANDLE handle_;
+		uint64_t position_ = 0;
+	};
+
+	// The open virtual handles, indexed by the handle given to the caller
+	// Every file call of the game has to check the registry, so an empty one is checked without taking the lock
+	class virtual_handle_registry
+	{
+	public:
+		void add(virtual_handle* handle)
+		{
+			std::unique_lock<std::shared_mutex> lock(lock_);
+
+			handles_[handle->get_handle()] = handle;
+			count_.store(handles_.size(), std::memory_order_relaxed);
+		}
+
+		void remove(virtual_handle* handle)
+		{
+			std::unique_lock<std::shared_mutex> lock(lock_);
+
+			handles_.erase(handle->get_handle());
+			count_.store(handles_.size(), std::memory_order_relaxed);
+		}
+
+		virtual_handle* find(HANDLE handle)
+		{
+			// Most handles the game uses are not virtual
+			if (count_.load(std::memory_order_relaxed) == 0)
+				return nullptr;
+
+			std::shared_lock<std::shared_mutex> lock(lock_);
+
+			const auto it = handles_.find(handle);
+			return it != handles_.end() ? it->second : nullptr;
+		}
+
+	private:
+		std::shared_mutex lock_;
+		std::unordered_map<HANDLE, virtual_handle*> handles_;
+		std::atomic<size_t> count_{0};
+	};
+}
@@ -1,17 +1,18 @@
 #pragma once
 #include <windows.h>
 #include <string>
+#include <string_view>
 
-static std::string narrow(std::wstring const& str)
+static std::string narrow(std::wstring_view str)
 {
-	const auto char_len = WideCharToMultiByte(CP_UTF8, 0, str.c_str(), str.length(), nullptr, 0, nullptr, nullptr);
+	const auto char_len = WideCharToMultiByte(CP_UTF8, 0, str.data(), str.length(), nullptr, 0, nullptr, nullptr);
 
 	if (char_len == 0)
 		return "";
 
 	std::string result;
 	result.resize(char_len);
-	WideCharToMultiByte(CP_UTF8, 0, str.c_str(), str.size(), const_cast<char*>(result.c_str()), char_len, nullptr, nullptr);
+	WideCharToMultiByte(CP_UTF8, 0, str.data(), str.size(), const_cast<char*>(result.c_str()), char_len, nullptr, nullptr);
 	return result;
 }
 
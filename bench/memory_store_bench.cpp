@@ -0,0 +1,212 @@
+/*
+ * memory_store_bench.cpp -- Linux benchmark of the in-memory write-back store.
+ *
+ * Simulates plugins that create lots of small scratch, lock and cache files, most of which are deleted again shortly.
+ * Each scenario is run once directly against the disk and once through vfs::memory_store.
+ *
+ * Build and run:
+ *     g++ -O2 -std=c++17 -I../VirtualFS memory_store_bench.cpp -o memory_store_bench -pthread
+ *     ./memory_store_bench [directory] [files] [--fsync]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "memory_store.h"
+
+namespace
+{
+	struct scenario
+	{
+		const char* name;
+		size_t min_size;
+		size_t max_size;
+		double delete_ratio;
+	};
+
+	struct result
+	{
+		double seconds;
+		size_t disk_writes;
+	};
+
+	bool Fsync = false;
+
+	std::string to_narrow(std::wstring const& str)
+	{
+		return std::string(str.begin(), str.end());
+	}
+
+	bool write_file(std::string const& path, const char* data, size_t size)
+	{
+		const auto fd = open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+
+		if (fd < 0)
+			return false;
+
+		const auto written = write(fd, data, size);
+
+		if (Fsync)
+			fsync(fd);
+
+		close(fd);
+		return written == static_cast<ssize_t>(size);
+	}
+
+	// The same sequence of files, sizes and deletes for both runs
+	struct operation
+	{
+		std::string path;
+		std::vector<char> data;
+		bool deleted;
+	};
+
+	std::vector<operation> make_operations(std::string const& directory, scenario const& s, size_t count)
+	{
+		std::mt19937 random(42);
+		std::uniform_int_distribution<size_t> size(s.min_size, s.max_size);
+		std::uniform_real_distribution<double> chance(0, 1);
+
+		std::vector<operation> operations;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			operation op;
+			op.path = directory + "/" + s.name + "_" + std::to_string(i) + ".tmp";
+			op.data.assign(size(random), static_cast<char>('a' + i % 26));
+			op.deleted = chance(random) < s.delete_ratio;
+			operations.push_back(std::move(op));
+		}
+
+		return operations;
+	}
+
+	result run_disk(std::vector<operation> const& operations)
+	{
+		size_t disk_writes = 0;
+		const auto start = std::chrono::steady_clock::now();
+
+		for (auto& op : operations)
+		{
+			write_file(op.path, op.data.data(), op.data.size());
+			disk_writes++;
+
+			if (op.deleted)
+				unlink(op.path.c_str());
+		}
+
+		const auto end = std::chrono::steady_clock::now();
+		return {std::chrono::duration<double>(end - start).count(), disk_writes};
+	}
+
+	result run_store(std::vector<operation> const& operations, size_t max_file_size)
+	{
+		size_t disk_writes = 0;
+
+		vfs::memory_store store(max_file_size, 16 << 20, [&](std::wstring const& path, const char* data, size_t size)
+		{
+			disk_writes++;
+			return write_file(to_narrow(path), data, size);
+		});
+
+		const auto start = std::chrono::steady_clock::now();
+
+		for (auto& op : operations)
+		{
+			const std::wstring path(op.path.begin(), op.path.end());
+			const auto file = store.create(path);
+
+			if (file == nullptr)
+			{
+				// The store is full, so the file is created on the disk
+				write_file(op.path, op.data.data(), op.data.size());
+				disk_writes++;
+			}
+			else if (!store.write(*file, 0, op.data.data(), op.data.size()))
+			{
+				// Too large for the store: like memory_handle::write, the file is opened on the disk once, the store
+				// flushes its contents through that descriptor and the write goes to it as well
+				const auto fd = open(op.path.c_str(), O_CREAT | O_WRONLY, 0644);
+
+				store.flush(*file, [fd](std::wstring const&, const char* data, size_t size)
+				{
+					return (size == 0 || pwrite(fd, data, size, 0) == static_cast<ssize_t>(size)) &&
+						ftruncate(fd, static_cast<off_t>(size)) == 0;
+				});
+
+				pwrite(fd, op.data.data(), op.data.size(), 0);
+
+				if (Fsync)
+					fsync(fd);
+
+				close(fd);
+				disk_writes++;
+			}
+
+			if (op.deleted && !store.remove(path))
+				unlink(op.path.c_str());
+		}
+
+		// Shutdown
+		store.flush_all();
+
+		const auto end = std::chrono::steady_clock::now();
+		return {std::chrono::duration<double>(end - start).count(), disk_writes};
+	}
+
+	void cleanup(std::vector<operation> const& operations)
+	{
+		for (auto& op : operations)
+			unlink(op.path.c_str());
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string directory = "/tmp";
+	size_t count = 5000;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--fsync") == 0)
+			Fsync = true;
+		else if (i == 1)
+			directory = argv[i];
+		else
+			count = strtoul(argv[i], nullptr, 10);
+	}
+
+	const size_t max_file_size = 64 * 1024;
+
+	const scenario scenarios[] = {
+		{"lock", 0, 64, 0.95},
+		{"scratch", 512, 8 * 1024, 0.8},
+		{"cache", 4 * 1024, 32 * 1024, 0.3},
+		{"overflow", 48 * 1024, 128 * 1024, 0.5},
+	};
+
+	printf("%-10s %12s %12s %12s %12s %8s\n", "scenario", "disk s", "store s", "disk writes", "store writes",
+	       "speedup");
+
+	for (auto& s : scenarios)
+	{
+		const auto operations = make_operations(directory, s, count);
+
+		const auto disk = run_disk(operations);
+		cleanup(operations);
+
+		const auto store = run_store(operations, max_file_size);
+		cleanup(operations);
+
+		printf("%-10s %12.4f %12.4f %12zu %12zu %7.1fx\n", s.name, disk.seconds, store.seconds, disk.disk_writes,
+		       store.disk_writes, disk.seconds / store.seconds);
+	}
+
+	return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * path_policy_bench.cpp -- Linux benchmark of the path engine under both path policies.
+ *
+ * Builds the same generated tree with ci_utf16 (what the hooks use on Windows) and cs_utf8,
+ * then times parsing the tree, resolving paths and matching search patterns with each.
+ *
+ * Build and run:
+ *     g++ -O2 -std=c++17 -I../VirtualFS path_policy_bench.cpp -o path_policy_bench -pthread
+ *     ./path_policy_bench [folders] [files per folder] [lookups]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "vfs_data.h"
+
+// The benchmark trees are parsed from JSON, so there are no layers to list
+template <>
+std::vector<vfs::details::directory_entry<vfs::ci_utf16>> vfs::details::list_directory<vfs::ci_utf16>(
+	std::wstring const&)
+{
+	return {};
+}
+
+template <>
+std::vector<vfs::details::directory_entry<vfs::cs_utf8>> vfs::details::list_directory<vfs::cs_utf8>(
+	std::string const&)
+{
+	return {};
+}
+
+namespace
+{
+	struct generated_tree
+	{
+		std::string json;
+
+		// UTF-8 paths with '\1' in place of the separator
+		std::vector<std::string> paths;
+	};
+
+	std::string get_file_name(size_t folder, size_t file)
+	{
+		// Every eighth file has a name outside of ASCII, which needs the slow folding path
+		if (file % 8 == 7)
+			return "\xC3\x9C" "bersetzung_" + std::to_string(folder) + "_" + std::to_string(file) + ".txt";
+
+		return "Asset" + std::to_string(file) + "_Mod" + std::to_string(folder) + (file % 2 ? ".bundle" : ".dll");
+	}
+
+	generated_tree generate_tree(size_t folder_count, size_t file_count)
+	{
+		generated_tree tree;
+		tree.json = "{\"BepInEx\":{\"plugins\":{";
+
+		for (size_t folder = 0; folder < folder_count; folder++)
+		{
+			const auto folder_name = "Plugin" + std::to_string(folder);
+			tree.json += (folder == 0 ? "\"" : ",\"") + folder_name + "\":{";
+
+			for (size_t file = 0; file < file_count; file++)
+			{
+				const auto file_name = get_file_name(folder, file);
+				tree.json += (file == 0 ? "\"" : ",\"") + file_name + "\":\"mods\\\\" + folder_name + "\\\\" +
+					file_name + "\"";
+				tree.paths.push_back("BepInEx\1plugins\1" + folder_name + "\1" + file_name);
+			}
+
+			tree.json += "}";
+		}
+
+		tree.json += "}}}";
+		return tree;
+	}
+
+	// Flips the case of ASCII letters, so that case-insensitive lookups have to fold
+	std::string flip_case(std::string str)
+	{
+		for (auto& c : str)
+		{
+			if (c >= 'a' && c <= 'z')
+				c = static_cast<char>(c - 'a' + 'A');
+			else if (c >= 'A' && c <= 'Z')
+				c = static_cast<char>(c - 'A' + 'a');
+		}
+		return str;
+	}
+
+	template <typename Policy>
+	typename Policy::string make_path(std::string path)
+	{
+		for (auto& c : path)
+		{
+			if (c == '\1')
+				c = static_cast<char>(Policy::separator);
+		}
+
+		return Policy::from_utf8(path);
+	}
+
+	struct result
+	{
+		double parse_seconds;
+		double resolve_seconds;
+		double match_seconds;
+		size_t found;
+		size_t matched;
+	};
+
+	template <typename Policy>
+	result run(generated_tree const& tree, std::vector<size_t> const& lookups, size_t folder_count)
+	{
+		using clock = std::chrono::steady_clock;
+		using string = typename Policy::string;
+
+		result r{};
+		vfs::basic_vfs_folder<Policy> root;
+
+		auto start = clock::now();
+		{
+			std::istringstream stream(tree.json);
+			root.parse(stream);
+		}
+		r.parse_seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+		// Case-insensitive lookups use the wrong case on purpose
+		std::vector<string> paths;
+		for (auto& path : tree.paths)
+			paths.push_back(make_path<Policy>(Policy::case_sensitive ? path : flip_case(path)));
+
+		start = clock::now();
+		for (const auto index : lookups)
+		{
+			if (vfs::resolve_path<Policy>(paths[index], &root) != nullptr)
+				r.found++;
+		}
+		r.resolve_seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+		const auto plugins = static_cast<vfs::basic_vfs_folder<Policy>*>(
+			vfs::resolve_path<Policy>(make_path<Policy>("BepInEx\1plugins"), &root));
+		const auto pattern_all = Policy::from_utf8("*");
+		const auto pattern_bundles = Policy::from_utf8("*.bundle");
+		const auto pattern_assets = Policy::from_utf8("Asset1?_*.dll");
+
+		start = clock::now();
+		for (size_t folder = 0; folder < folder_count; folder++)
+		{
+			const auto path = Policy::from_utf8("Plugin" + std::to_string(folder));
+			const auto item = vfs::resolve_path<Policy>(path, plugins);
+
+			for (auto& entry : static_cast<vfs::basic_vfs_folder<Policy>*>(item)->get_contents())
+			{
+				r.matched += vfs::match_pattern<Policy>(pattern_all, entry.first);
+				r.matched += vfs::match_pattern<Policy>(pattern_bundles, entry.first);
+				r.matched += vfs::match_pattern<Policy>(pattern_assets, entry.first);
+			}
+		}
+		r.match_seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+		return r;
+	}
+
+	void print(const char* name, result const& r, size_t lookups)
+	{
+		printf("%-9s %10.4f %10.4f %12.1f %10.4f %10zu %10zu\n", name, r.parse_seconds, r.resolve_seconds,
+		       r.resolve_seconds * 1e9 / lookups, r.match_seconds, r.found, r.matched);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const size_t folder_count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200;
+	const size_t file_count = argc > 2 ? strtoul(argv[2], nullptr, 10) : 100;
+	const size_t lookup_count = argc > 3 ? strtoul(argv[3], nullptr, 10) : 1000000;
+
+	const auto tree = generate_tree(folder_count, file_count);
+
+	std::mt19937 random(42);
+	std::uniform_int_distribution<size_t> pick(0, tree.paths.size() - 1);
+	std::vector<size_t> lookups(lookup_count);
+	for (auto& index : lookups)
+		index = pick(random);
+
+	printf("%zu files, %zu lookups\n", tree.paths.size(), lookup_count);
+	printf("%-9s %10s %10s %12s %10s %10s %10s\n", "policy", "parse s", "resolve s", "ns/lookup", "match s", "found",
+	       "matched");
+
+	print("ci_utf16", run<vfs::ci_utf16>(tree, lookups, folder_count), lookup_count);
+	print("cs_utf8", run<vfs::cs_utf8>(tree, lookups, folder_count), lookup_count);
+	return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * hook_allocations_test.cpp -- Linux test of the allocation budget of the hook path handling.
+ *
+ * Replaces the global operator new the same way VirtualFS.cpp does, then checks that building a path in a
+ * path_buffer, filtering it and resolving it in the tree allocates nothing once the tree has been walked.
+ * This is what vfs_last_hook_allocations reports for a redirected call on a warmed path.
+ *
+ * Build and run:
+ *     g++ -O2 -std=c++17 -I../VirtualFS hook_allocations_test.cpp -o hook_allocations_test -pthread
+ *     ./hook_allocations_test
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "alloc_counter.h"
+#include "path_buffer.h"
+#include "path_filter.h"
+#include "vfs_data.h"
+
+void* operator new(size_t size)
+{
+	++vfs::ThreadAllocations;
+
+	if (const auto p = malloc(size == 0 ? 1 : size))
+		return p;
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+// The test tree is parsed from JSON, so there are no layers to list
+template <>
+std::vector<vfs::details::directory_entry<vfs::ci_utf16>> vfs::details::list_directory<vfs::ci_utf16>(
+	std::wstring const&)
+{
+	return {};
+}
+
+namespace
+{
+	using folder = vfs::basic_vfs_folder<vfs::ci_utf16>;
+	using object = vfs::basic_vfs_object<vfs::ci_utf16>;
+
+	int Failures = 0;
+
+	void check(bool condition, const char* what)
+	{
+		if (!condition)
+		{
+			printf("FAILED: %s\n", what);
+			Failures++;
+		}
+	}
+
+	// What a redirected hook does with a path under the game folder: build it, filter it, resolve it
+	object* hook_resolve(folder& root, vfs::path_filter<vfs::ci_utf16> const& filter, std::wstring_view game_path,
+	                     std::wstring_view relative_path)
+	{
+		vfs::hook_scope scope;
+		scope.set_kind(vfs::hook_kind::redirected);
+
+		vfs::path_buffer full_path;
+		full_path.assign({game_path, relative_path});
+
+		const auto path = full_path.view().substr(game_path.length());
+
+		if (!filter.may_contain(root.get_path_hash(), path))
+			return nullptr;
+
+		return vfs::resolve_path<vfs::ci_utf16>(path, &root);
+	}
+}
+
+int main()
+{
+	std::istringstream json(
+		"{\"BepInEx\":{\"plugins\":{\"ModA\":{\"a.dll\":\"C:\\\\mods\\\\a.dll\",\"a.cfg\":\"C:\\\\mods\\\\a.cfg\"},"
+		"\"b.dll\":\"C:\\\\mods\\\\b.dll\"},\"config\":{\"BepInEx.cfg\":\"C:\\\\mods\\\\BepInEx.cfg\"}},"
+		"\"winhttp.dll\":\"C:\\\\mods\\\\winhttp.dll\"}");
+
+	folder root;
+	root.parse(json);
+
+	vfs::path_filter<vfs::ci_utf16> filter(vfs::path_filter<vfs::ci_utf16>::count_paths(root));
+	filter.add_tree(root);
+
+	const std::wstring game_path = L"C:\\Games\\Game";
+	const wchar_t* paths[] = {
+		L"\\BepInEx\\plugins\\ModA\\a.dll",
+		L"\\bepinex\\PLUGINS\\moda\\A.CFG",
+		L"\\BepInEx\\config\\BepInEx.cfg",
+		L"\\winhttp.dll",
+		L"\\BepInEx\\plugins\\missing.dll",
+	};
+
+	// The first walk may resolve folders lazily, which is allowed to allocate
+	for (auto path : paths)
+		hook_resolve(root, filter, game_path, path);
+
+	const auto violations = vfs::BudgetViolations.load();
+
+	for (auto path : paths)
+	{
+		const auto found = hook_resolve(root, filter, game_path, path);
+		const auto allocations = vfs::LastHookAllocations;
+
+		printf("%-40ls %-9s %llu allocations\n", path, found != nullptr ? "found" : "not found",
+		       static_cast<unsigned long long>(allocations));
+		check(allocations == 0, "a warmed path is resolved without allocating");
+	}
+
+	check(vfs::BudgetViolations.load() == violations, "no budget violations on warmed paths");
+
+	// A path too long for the stack buffer falls back to the heap once, which the redirected budget allows
+	const std::wstring long_path = L"\\BepInEx\\plugins\\" + std::wstring(vfs::path_buffer::capacity, L'x');
+	const auto found = hook_resolve(root, filter, game_path, long_path);
+	printf("%-40s %-9s %llu allocations\n", "(path longer than the buffer)", found != nullptr ? "found" : "not found",
+	       static_cast<unsigned long long>(vfs::LastHookAllocations));
+	check(vfs::LastHookAllocations == 1, "a path longer than the buffer allocates once");
+	check(vfs::BudgetViolations.load() == violations, "the heap fallback stays within the redirected budget");
+
+	if (Failures != 0)
+	{
+		printf("%d check(s) failed\n", Failures);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * name_table_test.cpp -- Linux test of the name table index.
+ *
+ * Inserts and erases names in random order, well past small_table_limit so that the open-addressing index is
+ * built and entries are removed from it by backward-shift deletion. After every step, every surviving name has to be
+ * found with its value and every erased name has to be gone. A reference std::map holds the expected contents.
+ *
+ * Build and run:
+ *     g++ -O2 -std=c++17 -I../VirtualFS name_table_test.cpp -o name_table_test
+ *     ./name_table_test [seed]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "name_table.h"
+
+namespace
+{
+	int Failures = 0;
+
+	void check(bool condition, const char* what, std::string const& name = std::string())
+	{
+		if (!condition)
+		{
+			printf("FAILED: %s %s\n", what, name.c_str());
+			Failures++;
+		}
+	}
+
+	template <typename Table>
+	void check_contents(Table& table, std::map<std::string, int> const& expected, std::vector<std::string> const& names)
+	{
+		check(table.size() == expected.size(), "table size matches");
+
+		for (auto& name : names)
+		{
+			const auto found = table.find(name);
+			const auto entry = expected.find(name);
+
+			if (entry == expected.end())
+				check(found == table.end(), "erased name is gone:", name);
+			else
+				check(found != table.end() && found->second == entry->second, "surviving name is found:", name);
+		}
+
+		// The entries themselves have to match as well, not just the lookups
+		std::map<std::string, int> listed;
+		for (auto& entry : table)
+			listed[entry.first] = entry.second;
+		check(listed == expected, "entries match");
+	}
+
+	void random_inserts_and_erases(unsigned seed)
+	{
+		using table_t = vfs::name_table<int, vfs::cs_utf8>;
+		constexpr size_t name_count = table_t::small_table_limit * 40;
+
+		std::mt19937 random(seed);
+		std::vector<std::string> names;
+		for (size_t i = 0; i < name_count; i++)
+			names.push_back("file_" + std::to_string(random()) + ".dll");
+
+		table_t table;
+		std::map<std::string, int> expected;
+		std::uniform_int_distribution<size_t> pick(0, name_count - 1);
+
+		// Grow well past the limit, churn, then shrink back down to around it
+		for (int phase = 0; phase < 3; phase++)
+		{
+			const auto steps = name_count * 4;
+
+			for (size_t step = 0; step < steps; step++)
+			{
+				auto& name = names[pick(random)];
+				const auto insert_chance = phase == 0 ? 80u : phase == 1 ? 50u : 1u;
+
+				if (random() % 100 < insert_chance)
+				{
+					const auto value = static_cast<int>(step);
+					table[name] = value;
+					expected[name] = value;
+				}
+				else
+				{
+					check(table.erase(name) == expected.erase(name), "erase reports whether the name was there:", name);
+				}
+
+				check_contents(table, expected, names);
+			}
+
+			printf("seed %u phase %d: %zu entries\n", seed, phase, table.size());
+		}
+	}
+
+	// Every name is erased in turn from a table holding the index, including the last entry moved into its place
+	void erase_each_position()
+	{
+		using table_t = vfs::name_table<int, vfs::ci_utf16>;
+		constexpr size_t count = table_t::small_table_limit * 4;
+
+		for (size_t erased = 0; erased < count; erased++)
+		{
+			table_t table;
+
+			for (size_t i = 0; i < count; i++)
+				table[L"Name" + std::to_wstring(i)] = static_cast<int>(i);
+
+			table.erase(L"NAME" + std::to_wstring(erased));
+			check(table.size() == count - 1, "one entry erased");
+
+			for (size_t i = 0; i < count; i++)
+			{
+				const auto found = table.find(L"name" + std::to_wstring(i));
+
+				if (i == erased)
+					check(found == table.end(), "erased name is gone (case-insensitive)");
+				else
+					check(found != table.end() && found->second == static_cast<int>(i),
+					      "surviving name is found (case-insensitive)");
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const auto seed = argc > 1 ? static_cast<unsigned>(strtoul(argv[1], nullptr, 10)) : 1u;
+
+	for (unsigned i = 0; i < 4; i++)
+		random_inserts_and_erases(seed + i);
+
+	erase_each_position();
+
+	if (Failures != 0)
+	{
+		printf("%d check(s) failed\n", Failures);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}